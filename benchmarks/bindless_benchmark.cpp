@@ -0,0 +1,124 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include <vulkan/vulkan.h>
+#include <vulkan/vulkan_beta.h>
+#include "vulkan/vulkan_core.h"
+#include "vulkan_base/vulkan_base.h"
+
+#define ELEMENT_COUNT (1 << 20)
+#define BUFFER_COUNT 8
+
+// Matches the push constants of bindless_saxpy.comp
+struct SaxpyConstants {
+    VkDeviceAddress y;
+    uint32_t xIndex;
+    uint32_t count;
+    float a;
+};
+
+VulkanContext* context;
+
+float scale(uint32_t buffer) {
+    return 0.5f * (buffer + 1);
+}
+
+int main(int argc, char* argv[]) {
+    const char* instanceExtensions[] = {
+        #ifdef __APPLE__
+        VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME,
+        #endif
+        VK_KHR_PORTABILITY_ENUMERATION_EXTENSION_NAME,
+    };
+    uint32_t instanceExtensionsCount = ARRAY_COUNT(instanceExtensions);
+
+    const char* deviceExtensions[] = {
+        #ifdef __APPLE__
+        VK_KHR_PORTABILITY_SUBSET_EXTENSION_NAME,
+        #endif
+    };
+    uint32_t deviceExtensionsCount = ARRAY_COUNT(deviceExtensions);
+
+    context = initVulkan(instanceExtensionsCount, instanceExtensions, deviceExtensionsCount, deviceExtensions);
+    if (!context->bindlessSupported || !context->bufferDeviceAddressSupported) {
+        printf("Skipped, the device supports no bindless descriptors or buffer device addresses\n");
+        exitVulkan(context);
+        return 0;
+    }
+
+    size_t bufferSize = ELEMENT_COUNT * sizeof(float);
+    std::vector<float> y(ELEMENT_COUNT);
+    std::vector<float> expected(ELEMENT_COUNT);
+    for (uint32_t i = 0; i < ELEMENT_COUNT; ++i) {
+        y[i] = (i % 7) / 7.0f;
+        expected[i] = y[i];
+    }
+
+    // Every x is registered once, the stages below only differ in the index they push
+    VulkanBindlessSet* bindlessSet = createBindlessSet(context, BUFFER_COUNT, 0, 0);
+    VulkanBuffer xBuffers[BUFFER_COUNT];
+    uint32_t xIndices[BUFFER_COUNT];
+    std::vector<float> x(ELEMENT_COUNT);
+    for (uint32_t buffer = 0; buffer < BUFFER_COUNT; ++buffer) {
+        for (uint32_t i = 0; i < ELEMENT_COUNT; ++i) {
+            x[i] = (i % 100) / 100.0f + buffer;
+            expected[i] = scale(buffer) * x[i] + expected[i];
+        }
+        createBuffer(context, &xBuffers[buffer], bufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        uploadDataToBufferWithStagingBuffer(context, &xBuffers[buffer], x.data(), bufferSize);
+        xIndices[buffer] = registerBindlessBuffer(context, bindlessSet, &xBuffers[buffer]);
+    }
+
+    VulkanBuffer yBuffer;
+    createBuffer(
+        context, &yBuffer, bufferSize,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+    );
+    uploadDataToBufferWithStagingBuffer(context, &yBuffer, y.data(), bufferSize);
+
+    VulkanPipeline pipeline = createBindlessPipeline(
+        context,
+        {"../shaders/bindless_saxpy.spv"},
+        {ivec3{(ELEMENT_COUNT + 255) / 256, 1, 1}},
+        bindlessSet,
+        sizeof(SaxpyConstants)
+    );
+
+    // y accumulates every x in turn, with one set bound for all of them
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands(context);
+    for (uint32_t buffer = 0; buffer < BUFFER_COUNT; ++buffer) {
+        SaxpyConstants constants = {getBufferDeviceAddress(context, &yBuffer), xIndices[buffer], ELEMENT_COUNT, scale(buffer)};
+        recordBindlessStage(commandBuffer, &pipeline, 0, bindlessSet, &constants);
+    }
+    auto start = std::chrono::high_resolution_clock::now();
+    endSingleTimeCommands(context, commandBuffer);
+    auto end = std::chrono::high_resolution_clock::now();
+    double ms = std::chrono::duration<double, std::milli>(end - start).count();
+    printf("saxpy %d buffers %10d elements %9.3f ms %8.2f GB/s\n", BUFFER_COUNT, ELEMENT_COUNT, ms, 3.0 * BUFFER_COUNT * bufferSize / (ms * 1.0e6));
+
+    bool correct = true;
+    getDataFromBufferWithStagingBuffer(context, &yBuffer, y.data(), bufferSize);
+    for (uint32_t i = 0; i < ELEMENT_COUNT; ++i) {
+        if (std::fabs(y[i] - expected[i]) > 1e-4f * std::max(1.0f, std::fabs(expected[i]))) {
+            LOG_ERROR("saxpy returned " << y[i] << " at " << i << ", expected " << expected[i]);
+            correct = false;
+            break;
+        }
+    }
+
+    // endSingleTimeCommands waited for the submission, so nothing is executing anymore
+    destroyPipeline(context, &pipeline);
+    destroyBindlessSet(context, bindlessSet);
+    for (uint32_t buffer = 0; buffer < BUFFER_COUNT; ++buffer) {
+        destroyBuffer(context, &xBuffers[buffer]);
+    }
+    destroyBuffer(context, &yBuffer);
+    exitVulkan(context);
+    return correct ? 0 : 1;
+}
@@ -0,0 +1,111 @@
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include <vulkan/vulkan.h>
+#include <vulkan/vulkan_beta.h>
+#include "vulkan/vulkan_core.h"
+#include "vulkan_base/vulkan_base.h"
+
+// Jacobi iteration for the 1D Laplace equation with the boundaries fixed at 0 and 1, which converges to a line
+#define ELEMENT_COUNT 64
+#define MAX_ITERATIONS 20000
+
+VulkanContext* context;
+VulkanDescriptorSet* descriptorSetInfo;
+VulkanBuffer firstBuffer;
+VulkanBuffer secondBuffer;
+VulkanBuffer statusBuffer;
+std::vector<float> initialValues(ELEMENT_COUNT);
+
+// Both buffers start from the boundaries with zeros in between, so every run does the same work
+void resetBuffers() {
+    uploadDataToBufferWithStagingBuffer(context, &firstBuffer, initialValues.data(), ELEMENT_COUNT * sizeof(float));
+    uploadDataToBufferWithStagingBuffer(context, &secondBuffer, initialValues.data(), ELEMENT_COUNT * sizeof(float));
+}
+
+bool checkSolution(uint32_t checkInterval) {
+    std::vector<float> result(ELEMENT_COUNT);
+    getDataFromBufferWithStagingBuffer(context, &firstBuffer, result.data(), ELEMENT_COUNT * sizeof(float));
+    for (uint32_t i = 0; i < ELEMENT_COUNT; ++i) {
+        float expected = float(i) / (ELEMENT_COUNT - 1);
+        if (std::fabs(result[i] - expected) > 5e-3f) {
+            LOG_ERROR("interval " << checkInterval << " returned " << result[i] << " at " << i << ", expected " << expected);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    const char* instanceExtensions[] = {
+        #ifdef __APPLE__
+        VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME,
+        #endif
+        VK_KHR_PORTABILITY_ENUMERATION_EXTENSION_NAME,
+    };
+    uint32_t instanceExtensionsCount = ARRAY_COUNT(instanceExtensions);
+
+    const char* deviceExtensions[] = {
+        #ifdef __APPLE__
+        VK_KHR_PORTABILITY_SUBSET_EXTENSION_NAME,
+        #endif
+    };
+    uint32_t deviceExtensionsCount = ARRAY_COUNT(deviceExtensions);
+
+    context = initVulkan(instanceExtensionsCount, instanceExtensions, deviceExtensionsCount, deviceExtensions);
+
+    initialValues[ELEMENT_COUNT - 1] = 1.0f;
+    descriptorSetInfo = initDescriptorSet();
+    addDescriptorSetLayout(descriptorSetInfo, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    addDescriptorSetLayout(descriptorSetInfo, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    addDescriptorSetLayout(descriptorSetInfo, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    createDescriptorSet(context, descriptorSetInfo);
+    VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    descriptorSetInfo->addBufferAndData(context, &firstBuffer, NULL, ELEMENT_COUNT * sizeof(float), usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    descriptorSetInfo->addBufferAndData(context, &secondBuffer, NULL, ELEMENT_COUNT * sizeof(float), usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    descriptorSetInfo->addBufferAndData(context, &statusBuffer, NULL, sizeof(uint32_t), usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    fillDescriptorSet(context, descriptorSetInfo);
+
+    // One iteration sweeps from the first buffer into the second and back, so the check always reads the first one
+    ivec3 dispatch = {(ELEMENT_COUNT + 63) / 64, 1, 1};
+    VulkanPipeline jacobiPipeline = createPipeline(
+        context,
+        {"../shaders/jacobi_step.spv", "../shaders/jacobi_step.spv"},
+        {dispatch, dispatch},
+        descriptorSetInfo, 0,
+        {{VK_FALSE}, {VK_TRUE}}
+    );
+    VulkanPipeline checkPipeline = createPipeline(context, {"../shaders/jacobi_check.spv"}, {dispatch}, descriptorSetInfo);
+
+    // A short interval stops closer to the converged iteration, a long one reads the status less often
+    bool correct = true;
+    const uint32_t checkIntervals[] = {1, 16, 64};
+    for (uint32_t checkInterval : checkIntervals) {
+        resetBuffers();
+        bool converged;
+        auto start = std::chrono::high_resolution_clock::now();
+        uint32_t iterations = runUntilConverged(context, &jacobiPipeline, &checkPipeline, descriptorSetInfo, &statusBuffer, MAX_ITERATIONS, checkInterval, &converged);
+        auto end = std::chrono::high_resolution_clock::now();
+        double ms = std::chrono::duration<double, std::milli>(end - start).count();
+        printf("interval %3u %6u iterations %9.3f ms %s\n", checkInterval, iterations, ms, converged ? "converged" : "not converged");
+        if (!converged) {
+            LOG_ERROR("interval " << checkInterval << " did not converge within " << MAX_ITERATIONS << " iterations");
+        }
+        correct = converged && checkSolution(checkInterval) && correct;
+    }
+
+    // runUntilConverged waited for its last batch, so nothing is executing anymore
+    destroyPipeline(context, &jacobiPipeline);
+    destroyPipeline(context, &checkPipeline);
+    destroyBuffer(context, &firstBuffer);
+    destroyBuffer(context, &secondBuffer);
+    destroyBuffer(context, &statusBuffer);
+    destroyDescriptorSet(context, descriptorSetInfo);
+    delete descriptorSetInfo;
+    exitVulkan(context);
+    return correct ? 0 : 1;
+}
@@ -0,0 +1,142 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include <vulkan/vulkan.h>
+#include <vulkan/vulkan_beta.h>
+#include "vulkan/vulkan_core.h"
+#include "vulkan_base/vulkan_base.h"
+
+#define ELEMENT_COUNT (1 << 24)
+#define ITERATIONS 10
+
+// Set by CMake to a directory in the build tree, the first argument overrides it
+#ifndef FUSION_CACHE_DIR
+#define FUSION_CACHE_DIR "fused_shaders"
+#endif
+
+VulkanContext* context;
+VulkanFusionCache* fusionCache;
+
+// The chain of elementwise stages and its parameters, one value per parameter in chain order
+const std::vector<VulkanElementwiseStage> chain = {
+    {"x * 5.0", 0},
+    {"x + p0", 1},
+    {"max(x, p0)", 1},
+};
+const float parameters[] = {4.0f, 20.0f};
+
+float cpuChain(float x) {
+    return std::max(x * 5.0f + parameters[0], parameters[1]);
+}
+
+// Runs record ITERATIONS times in one command buffer each, after one warm-up run
+template <typename Record>
+double benchmark(const char* name, Record record) {
+    double totalMs = 0.0;
+    for (int i = 0; i <= ITERATIONS; ++i) {
+        VkCommandBuffer commandBuffer = beginSingleTimeCommands(context);
+        record(commandBuffer);
+        auto start = std::chrono::high_resolution_clock::now();
+        endSingleTimeCommands(context, commandBuffer);
+        auto end = std::chrono::high_resolution_clock::now();
+        if (i > 0) {
+            totalMs += std::chrono::duration<double, std::milli>(end - start).count();
+        }
+    }
+    double ms = totalMs / ITERATIONS;
+    printf("%-10s %10d elements %9.3f ms %8.2f GB/s\n", name, ELEMENT_COUNT, ms, 2.0 * ELEMENT_COUNT * sizeof(float) / (ms * 1.0e6));
+    return ms;
+}
+
+// Clears the output, so a kernel that writes nothing cannot pass with the results of the previous one
+void clearBuffer(VulkanBuffer* buffer) {
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands(context);
+    vkCmdFillBuffer(commandBuffer, buffer->buffer, 0, VK_WHOLE_SIZE, 0);
+    endSingleTimeCommands(context, commandBuffer);
+}
+
+bool checkOutput(const char* name, VulkanBuffer* output, const std::vector<float>& input) {
+    std::vector<float> result(ELEMENT_COUNT);
+    getDataFromBufferWithStagingBuffer(context, output, result.data(), ELEMENT_COUNT * sizeof(float));
+    for (uint32_t i = 0; i < ELEMENT_COUNT; ++i) {
+        if (std::fabs(result[i] - cpuChain(input[i])) > 1e-3f) {
+            LOG_ERROR(name << " returned " << result[i] << " at " << i << ", expected " << cpuChain(input[i]));
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    const char* cacheDirectory = argc > 1 ? argv[1] : FUSION_CACHE_DIR;
+
+    const char* instanceExtensions[] = {
+        #ifdef __APPLE__
+        VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME,
+        #endif
+        VK_KHR_PORTABILITY_ENUMERATION_EXTENSION_NAME,
+    };
+    uint32_t instanceExtensionsCount = ARRAY_COUNT(instanceExtensions);
+
+    const char* deviceExtensions[] = {
+        #ifdef __APPLE__
+        VK_KHR_PORTABILITY_SUBSET_EXTENSION_NAME,
+        #endif
+    };
+    uint32_t deviceExtensionsCount = ARRAY_COUNT(deviceExtensions);
+
+    context = initVulkan(instanceExtensionsCount, instanceExtensions, deviceExtensionsCount, deviceExtensions);
+    fusionCache = createFusionCache(context, cacheDirectory);
+
+    std::vector<float> input(ELEMENT_COUNT);
+    for (uint32_t i = 0; i < ELEMENT_COUNT; ++i) {
+        input[i] = (i % 1000) / 100.0f;
+    }
+    size_t bufferSize = ELEMENT_COUNT * sizeof(float);
+    VulkanBuffer inputBuffer, outputBuffer;
+    VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    createBuffer(context, &inputBuffer, bufferSize, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    createBuffer(context, &outputBuffer, bufferSize, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    uploadDataToBufferWithStagingBuffer(context, &inputBuffer, input.data(), bufferSize);
+
+    // The separate passes are the stages of the chain on their own, the first one reads the input and the rest work in place
+    std::vector<VulkanFusedKernel*> passes;
+    for (const VulkanElementwiseStage& stage : chain) {
+        passes.push_back(getFusedKernel(context, fusionCache, {stage}));
+    }
+    VulkanFusedKernel* fusedKernel = getFusedKernel(context, fusionCache, chain);
+    VkDescriptorSet firstSet = allocateFusedDescriptorSet(context, fusionCache, &inputBuffer, &outputBuffer);
+    VkDescriptorSet inPlaceSet = allocateFusedDescriptorSet(context, fusionCache, &outputBuffer, &outputBuffer);
+
+    bool correct = true;
+    clearBuffer(&outputBuffer);
+    double separateMs = benchmark("separate", [&](VkCommandBuffer commandBuffer) {
+        const float* stageParameters = parameters;
+        for (size_t i = 0; i < passes.size(); ++i) {
+            recordFusedKernel(commandBuffer, passes[i], i == 0 ? firstSet : inPlaceSet, ELEMENT_COUNT, stageParameters);
+            stageParameters += passes[i]->parameterCount;
+        }
+    });
+    correct = checkOutput("separate", &outputBuffer, input) && correct;
+
+    clearBuffer(&outputBuffer);
+    double fusedMs = benchmark("fused", [&](VkCommandBuffer commandBuffer) {
+        recordFusedKernel(commandBuffer, fusedKernel, firstSet, ELEMENT_COUNT, parameters);
+    });
+    correct = checkOutput("fused", &outputBuffer, input) && correct;
+    printf("Fusing %zu stages: %.2fx\n", chain.size(), separateMs / fusedMs);
+
+    // Every run waited for its submission, so nothing is executing anymore
+    releaseJobDescriptorSet(fusionCache->descriptorAllocator, firstSet);
+    releaseJobDescriptorSet(fusionCache->descriptorAllocator, inPlaceSet);
+    destroyFusionCache(context, fusionCache);
+    destroyBuffer(context, &inputBuffer);
+    destroyBuffer(context, &outputBuffer);
+    exitVulkan(context);
+    return correct ? 0 : 1;
+}
@@ -0,0 +1,90 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+#include <vulkan/vulkan.h>
+#include <vulkan/vulkan_beta.h>
+#include "vulkan/vulkan_core.h"
+#include "vulkan_base/vulkan_base.h"
+
+#define ELEMENT_COUNT (1 << 24)
+#define DATA_FILENAME "import_benchmark.bin"
+
+VulkanContext* context;
+VulkanPrimitives* primitives;
+VulkanBuffer outputBuffer;
+
+// Times getting the data into a buffer plus one reduction that reads all of it, returns the milliseconds
+template <typename CreateInput>
+double benchmark(const char* name, CreateInput createInput) {
+    auto start = std::chrono::high_resolution_clock::now();
+    VulkanBuffer input;
+    bool imported = createInput(&input);
+    reduceSum(context, primitives, &input, &outputBuffer, ELEMENT_COUNT);
+    auto end = std::chrono::high_resolution_clock::now();
+
+    // reduceSum waited for its submission, so the buffer can go before the host memory it may wrap
+    destroyBuffer(context, &input);
+    float sum;
+    getDataFromBufferWithStagingBuffer(context, &outputBuffer, &sum, sizeof(sum));
+
+    double ms = std::chrono::duration<double, std::milli>(end - start).count();
+    printf("%-10s %9.3f ms %9.2f GB/s  sum %.1f%s\n", name, ms, ELEMENT_COUNT * sizeof(float) / (ms * 1.0e6), sum, imported ? "" : " (staged)");
+    return ms;
+}
+
+int main(int argc, char* argv[]) {
+    const char* instanceExtensions[] = {
+        #ifdef __APPLE__
+        VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME,
+        #endif
+        VK_KHR_PORTABILITY_ENUMERATION_EXTENSION_NAME,
+    };
+    uint32_t instanceExtensionsCount = ARRAY_COUNT(instanceExtensions);
+
+    const char* deviceExtensions[] = {
+        #ifdef __APPLE__
+        VK_KHR_PORTABILITY_SUBSET_EXTENSION_NAME,
+        #endif
+    };
+    uint32_t deviceExtensionsCount = ARRAY_COUNT(deviceExtensions);
+
+    context = initVulkan(instanceExtensionsCount, instanceExtensions, deviceExtensionsCount, deviceExtensions);
+    primitives = initPrimitives(context, ELEMENT_COUNT);
+    createBuffer(context, &outputBuffer, sizeof(float), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    size_t size = ELEMENT_COUNT * sizeof(float);
+    float* data = static_cast<float*>(allocateHostImportMemory(context, size));
+    for (uint32_t i = 0; i < ELEMENT_COUNT; ++i) {
+        data[i] = (i % 100) / 100.0f;
+    }
+    FILE* file = fopen(DATA_FILENAME, "wb");
+    if (!file || fwrite(data, 1, size, file) != size) {
+        throw std::runtime_error("failed to write " DATA_FILENAME);
+    }
+    fclose(file);
+
+    printf("Import alignment %llu B\n", (unsigned long long)getHostImportAlignment(context));
+    benchmark("staged", [&](VulkanBuffer* input) {
+        createBuffer(context, input, static_cast<uint32_t>(size), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        uploadDataToBufferWithStagingBuffer(context, input, data, size);
+        return false;
+    });
+    benchmark("imported", [&](VulkanBuffer* input) {
+        return importHostBuffer(context, input, data, size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    });
+    VulkanMappedFile mappedFile;
+    benchmark("file", [&](VulkanBuffer* input) {
+        mapFileForImport(context, &mappedFile, DATA_FILENAME);
+        return importFileBuffer(context, input, &mappedFile, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    });
+    unmapFile(&mappedFile);
+    remove(DATA_FILENAME);
+
+    freeHostImportMemory(data);
+    destroyBuffer(context, &outputBuffer);
+    destroyPrimitives(context, primitives);
+    exitVulkan(context);
+    return 0;
+}
@@ -0,0 +1,211 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <vulkan/vulkan.h>
+#include <vulkan/vulkan_beta.h>
+#include "vulkan/vulkan_core.h"
+#include "vulkan_base/vulkan_base.h"
+
+#define ELEMENT_COUNT (1 << 24)
+#define ITERATIONS 10
+
+VulkanContext* context;
+VulkanPrimitives* primitives;
+
+void createDeviceBuffer(VulkanBuffer* buffer, void* data, size_t size) {
+    createBuffer(
+        context,
+        buffer,
+        size,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+    );
+    if (data != NULL) {
+        uploadDataToBufferWithStagingBuffer(context, buffer, data, size);
+    }
+}
+
+// Runs the primitive ITERATIONS times after one warm-up call, setup re-uploads inputs that the primitive overwrites
+template <typename Setup, typename Run>
+double benchmark(const char* name, size_t bytesTouched, Setup setup, Run run) {
+    setup();
+    run();
+
+    double totalMs = 0.0;
+    for (int i = 0; i < ITERATIONS; ++i) {
+        setup();
+        auto start = std::chrono::high_resolution_clock::now();
+        run();
+        auto end = std::chrono::high_resolution_clock::now();
+        totalMs += std::chrono::duration<double, std::milli>(end - start).count();
+    }
+
+    double ms = totalMs / ITERATIONS;
+    printf("%-12s %10d elements %9.3f ms %9.2f Melem/s %8.2f GB/s\n",
+        name, ELEMENT_COUNT, ms, ELEMENT_COUNT / (ms * 1000.0), bytesTouched / (ms * 1.0e6));
+    return ms;
+}
+
+// Times the CPU reference the same way, its results of the last run stay in place for the comparison
+template <typename Setup, typename Run>
+double cpuBenchmark(Setup setup, Run run) {
+    double totalMs = 0.0;
+    for (int i = 0; i < ITERATIONS; ++i) {
+        setup();
+        auto start = std::chrono::high_resolution_clock::now();
+        run();
+        auto end = std::chrono::high_resolution_clock::now();
+        totalMs += std::chrono::duration<double, std::milli>(end - start).count();
+    }
+    return totalMs / ITERATIONS;
+}
+
+int main(int argc, char* argv[]) {
+    const char* instanceExtensions[] = {
+        #ifdef __APPLE__
+        VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME,
+        #endif
+        VK_KHR_PORTABILITY_ENUMERATION_EXTENSION_NAME,
+    };
+    uint32_t instanceExtensionsCount = ARRAY_COUNT(instanceExtensions);
+
+    const char* deviceExtensions[] = {
+        #ifdef __APPLE__
+        VK_KHR_PORTABILITY_SUBSET_EXTENSION_NAME,
+        #endif
+    };
+    uint32_t deviceExtensionsCount = ARRAY_COUNT(deviceExtensions);
+
+    context = initVulkan(instanceExtensionsCount, instanceExtensions, deviceExtensionsCount, deviceExtensions);
+    primitives = initPrimitives(context, ELEMENT_COUNT);
+
+    std::mt19937 random(42);
+    std::vector<float> floats(ELEMENT_COUNT);
+    std::vector<uint32_t> keys(ELEMENT_COUNT);
+    std::vector<uint32_t> values(ELEMENT_COUNT);
+    std::vector<uint32_t> flags(ELEMENT_COUNT);
+    for (uint32_t i = 0; i < ELEMENT_COUNT; ++i) {
+        floats[i] = (random() % 100) / 100.0f;
+        keys[i] = random();
+        values[i] = i;
+        flags[i] = keys[i] & 1;
+    }
+    size_t bufferSize = ELEMENT_COUNT * sizeof(uint32_t);
+
+    VulkanBuffer floatBuffer, keyBuffer, valueBuffer, flagBuffer, outputBuffer, countBuffer;
+    createDeviceBuffer(&floatBuffer, floats.data(), bufferSize);
+    createDeviceBuffer(&keyBuffer, keys.data(), bufferSize);
+    createDeviceBuffer(&valueBuffer, values.data(), bufferSize);
+    createDeviceBuffer(&flagBuffer, flags.data(), bufferSize);
+    createDeviceBuffer(&outputBuffer, NULL, bufferSize);
+    createDeviceBuffer(&countBuffer, NULL, sizeof(uint32_t));
+
+    auto noSetup = [](){};
+    CpuThreadPool* pool = createCpuThreadPool();
+    std::vector<uint32_t> result(ELEMENT_COUNT);
+    std::vector<uint32_t> expected(ELEMENT_COUNT);
+
+    {
+        CpuComparison comparison = {"reduce"};
+        comparison.gpuMs = benchmark("reduce", bufferSize, noSetup, [&](){
+            reduceSum(context, primitives, &floatBuffer, &outputBuffer, ELEMENT_COUNT);
+        });
+        float gpuSum, cpuSum;
+        comparison.cpuMs = cpuBenchmark(noSetup, [&](){
+            cpuSum = cpuReduceSum(pool, floats.data(), ELEMENT_COUNT);
+        });
+        getDataFromBufferWithStagingBuffer(context, &outputBuffer, &gpuSum, sizeof(gpuSum));
+        // Both sums are accumulated in a different order
+        compareFloatResults(&comparison, &gpuSum, &cpuSum, 1, 1e-3f);
+        printCpuComparison(&comparison);
+    }
+
+    {
+        CpuComparison comparison = {"scan"};
+        comparison.gpuMs = benchmark("scan", 2 * bufferSize, noSetup, [&](){
+            prefixSum(context, primitives, &flagBuffer, &outputBuffer, ELEMENT_COUNT, false);
+        });
+        comparison.cpuMs = cpuBenchmark(noSetup, [&](){
+            cpuPrefixSum(pool, flags.data(), expected.data(), ELEMENT_COUNT, false);
+        });
+        getDataFromBufferWithStagingBuffer(context, &outputBuffer, result.data(), bufferSize);
+        compareUintResults(&comparison, result.data(), expected.data(), ELEMENT_COUNT);
+        printCpuComparison(&comparison);
+    }
+
+    {
+        CpuComparison comparison = {"histogram"};
+        comparison.gpuMs = benchmark("histogram", bufferSize, noSetup, [&](){
+            computeHistogram(context, primitives, &keyBuffer, &outputBuffer, ELEMENT_COUNT, 256, 24);
+        });
+        comparison.cpuMs = cpuBenchmark(noSetup, [&](){
+            cpuHistogram(pool, keys.data(), expected.data(), ELEMENT_COUNT, 256, 24);
+        });
+        getDataFromBufferWithStagingBuffer(context, &outputBuffer, result.data(), 256 * sizeof(uint32_t));
+        compareUintResults(&comparison, result.data(), expected.data(), 256);
+        printCpuComparison(&comparison);
+    }
+
+    {
+        CpuComparison comparison = {"compact"};
+        comparison.gpuMs = benchmark("compact", 3 * bufferSize, noSetup, [&](){
+            compactBuffer(context, primitives, &keyBuffer, &flagBuffer, &outputBuffer, &countBuffer, ELEMENT_COUNT);
+        });
+        uint32_t gpuCount, cpuCount;
+        comparison.cpuMs = cpuBenchmark(noSetup, [&](){
+            cpuCount = cpuCompact(pool, keys.data(), flags.data(), expected.data(), ELEMENT_COUNT);
+        });
+        getDataFromBufferWithStagingBuffer(context, &countBuffer, &gpuCount, sizeof(gpuCount));
+        if (gpuCount != cpuCount) {
+            LOG_ERROR("compact kept " << gpuCount << " elements, the CPU reference " << cpuCount);
+        }
+        uint32_t count = std::min(gpuCount, cpuCount);
+        getDataFromBufferWithStagingBuffer(context, &outputBuffer, result.data(), count * sizeof(uint32_t));
+        compareUintResults(&comparison, result.data(), expected.data(), count);
+        printCpuComparison(&comparison);
+    }
+
+    // Sorting happens in place, so every run starts from the unsorted input again
+    {
+        CpuComparison comparison = {"sort keys"};
+        comparison.gpuMs = benchmark("radix sort", 2 * 8 * 2 * bufferSize, [&](){
+            uploadDataToBufferWithStagingBuffer(context, &keyBuffer, keys.data(), bufferSize);
+            uploadDataToBufferWithStagingBuffer(context, &valueBuffer, values.data(), bufferSize);
+        }, [&](){
+            radixSortPairs(context, primitives, &keyBuffer, &valueBuffer, ELEMENT_COUNT);
+        });
+        std::vector<uint32_t> sortedKeys(ELEMENT_COUNT);
+        std::vector<uint32_t> sortedValues(ELEMENT_COUNT);
+        comparison.cpuMs = cpuBenchmark([&](){
+            sortedKeys = keys;
+            sortedValues = values;
+        }, [&](){
+            cpuRadixSortPairs(pool, sortedKeys.data(), sortedValues.data(), ELEMENT_COUNT);
+        });
+        // Both sorts are stable, so the values have to match as well
+        getDataFromBufferWithStagingBuffer(context, &keyBuffer, result.data(), bufferSize);
+        compareUintResults(&comparison, result.data(), sortedKeys.data(), ELEMENT_COUNT);
+        printCpuComparison(&comparison);
+        comparison.name = "sort values";
+        getDataFromBufferWithStagingBuffer(context, &valueBuffer, result.data(), bufferSize);
+        compareUintResults(&comparison, result.data(), sortedValues.data(), ELEMENT_COUNT);
+        printCpuComparison(&comparison);
+    }
+    destroyCpuThreadPool(pool);
+
+    // Every primitive waits for its own submission, so nothing is executing anymore
+    deferDestroyBuffer(context, &floatBuffer);
+    deferDestroyBuffer(context, &keyBuffer);
+    deferDestroyBuffer(context, &valueBuffer);
+    deferDestroyBuffer(context, &flagBuffer);
+    deferDestroyBuffer(context, &outputBuffer);
+    deferDestroyBuffer(context, &countBuffer);
+    destroyPrimitives(context, primitives);
+    exitVulkan(context);
+    return 0;
+}
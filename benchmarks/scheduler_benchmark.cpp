@@ -0,0 +1,160 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <future>
+#include <iostream>
+#include <thread>
+#include <vulkan/vulkan.h>
+#include <vulkan/vulkan_beta.h>
+#include "vulkan/vulkan_core.h"
+#include "vulkan_base/vulkan_base.h"
+
+#define JOB_COUNT 256
+#define JOB_ELEMENTS 4096
+#define CLIENT_THREADS 4
+
+VulkanContext* context;
+VulkanDescriptorSet* descriptorSetInfo;
+VulkanDescriptorAllocator* descriptorAllocator;
+VulkanPipeline pipeline;
+VulkanBuffer uniformBuffer;
+std::vector<VulkanBuffer> jobBuffers;
+std::vector<std::vector<float>> inputs;
+std::vector<std::vector<float>> outputs;
+
+// test1.comp on the buffer of the job, uploading its input and downloading the result
+VulkanComputeJob makeJob(uint32_t index) {
+    VulkanComputeJob job;
+    job.pipeline = &pipeline;
+    job.descriptorAllocator = descriptorAllocator;
+    job.resources = {describeBuffer(&jobBuffers[index]), describeBuffer(&uniformBuffer)};
+    job.uploads = {{&jobBuffers[index], 0, inputs[index].data(), JOB_ELEMENTS * sizeof(float)}};
+    job.downloads = {{&jobBuffers[index], 0, outputs[index].data(), JOB_ELEMENTS * sizeof(float)}};
+    job.priority = index % 4 == 0 ? JobPriority::HIGH : JobPriority::NORMAL;
+    return job;
+}
+
+bool checkOutputs() {
+    for (uint32_t i = 0; i < JOB_COUNT; ++i) {
+        for (uint32_t j = 0; j < JOB_ELEMENTS; ++j) {
+            if (outputs[i][j] != inputs[i][j] * 5.0f) {
+                LOG_ERROR("job " << i << " returned wrong results");
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Every client thread submits its share of the jobs and then waits for all of their futures
+double runJobs(uint32_t maxJobsInFlight, uint32_t maxBatchSize, uint32_t clientThreads, bool waitForEach, bool* correct) {
+    for (auto& output : outputs) {
+        std::fill(output.begin(), output.end(), 0.0f);
+    }
+    VulkanScheduler* scheduler = createScheduler(context, maxJobsInFlight, maxBatchSize);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<std::thread> clients;
+    for (uint32_t t = 0; t < clientThreads; ++t) {
+        clients.push_back(std::thread([=]() {
+            std::vector<std::future<void>> futures;
+            for (uint32_t i = t; i < JOB_COUNT; i += clientThreads) {
+                futures.push_back(submitJob(scheduler, makeJob(i)));
+                if (waitForEach) {
+                    futures.back().get();
+                }
+            }
+            for (auto& future : futures) {
+                if (future.valid()) {
+                    future.get();
+                }
+            }
+        }));
+    }
+    for (auto& client : clients) {
+        client.join();
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    destroyScheduler(scheduler);
+    *correct = checkOutputs();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+int main(int argc, char* argv[]) {
+    const char* instanceExtensions[] = {
+        #ifdef __APPLE__
+        VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME,
+        #endif
+        VK_KHR_PORTABILITY_ENUMERATION_EXTENSION_NAME,
+    };
+    uint32_t instanceExtensionsCount = ARRAY_COUNT(instanceExtensions);
+
+    const char* deviceExtensions[] = {
+        #ifdef __APPLE__
+        VK_KHR_PORTABILITY_SUBSET_EXTENSION_NAME,
+        #endif
+    };
+    uint32_t deviceExtensionsCount = ARRAY_COUNT(deviceExtensions);
+
+    context = initVulkan(instanceExtensionsCount, instanceExtensions, deviceExtensionsCount, deviceExtensions);
+
+    descriptorSetInfo = initDescriptorSet();
+    addDescriptorSetLayout(descriptorSetInfo, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    addDescriptorSetLayout(descriptorSetInfo, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
+    createDescriptorSetLayout(context, descriptorSetInfo);
+    descriptorAllocator = createDescriptorAllocator(context, descriptorSetInfo, 64);
+    pipeline = createPipeline(context, {"../shaders/test1.spv"}, {ivec3{JOB_ELEMENTS, 1, 1}}, descriptorSetInfo);
+
+    float offset = 0.0f;
+    createBuffer(context, &uniformBuffer, sizeof(offset), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    uploadDataToBufferWithStagingBuffer(context, &uniformBuffer, &offset, sizeof(offset));
+
+    jobBuffers.resize(JOB_COUNT);
+    inputs.resize(JOB_COUNT, std::vector<float>(JOB_ELEMENTS));
+    outputs.resize(JOB_COUNT, std::vector<float>(JOB_ELEMENTS));
+    for (uint32_t i = 0; i < JOB_COUNT; ++i) {
+        createBuffer(
+            context,
+            &jobBuffers[i],
+            JOB_ELEMENTS * sizeof(float),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+        );
+        for (uint32_t j = 0; j < JOB_ELEMENTS; ++j) {
+            inputs[i][j] = float(i + j);
+        }
+    }
+
+    printf("%-28s %10s %12s\n", "mode", "ms", "jobs/s");
+    struct {
+        const char* name;
+        uint32_t maxJobsInFlight;
+        uint32_t maxBatchSize;
+        uint32_t clientThreads;
+        bool waitForEach;
+    } modes[] = {
+        {"one at a time", 1, 1, 1, true},
+        {"concurrent, no batching", 32, 1, CLIENT_THREADS, false},
+        {"concurrent, batches of 16", 64, 16, CLIENT_THREADS, false},
+    };
+    bool allCorrect = true;
+    for (const auto& mode : modes) {
+        bool correct;
+        double ms = runJobs(mode.maxJobsInFlight, mode.maxBatchSize, mode.clientThreads, mode.waitForEach, &correct);
+        printf("%-28s %10.3f %12.1f%s\n", mode.name, ms, JOB_COUNT / (ms / 1000.0), correct ? "" : "  WRONG RESULTS");
+        allCorrect = allCorrect && correct;
+    }
+
+    // The schedulers waited for all of their jobs, so nothing is executing anymore
+    for (VulkanBuffer& buffer : jobBuffers) {
+        deferDestroyBuffer(context, &buffer);
+    }
+    deferDestroyBuffer(context, &uniformBuffer);
+    deferDestroyPipeline(context, &pipeline);
+    destroyDescriptorAllocator(context, descriptorAllocator);
+    deferDestroyDescriptorSet(context, descriptorSetInfo);
+    exitVulkan(context);
+    return allCorrect ? 0 : 1;
+}
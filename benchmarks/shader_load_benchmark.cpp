@@ -0,0 +1,72 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vulkan/vulkan.h>
+#include <vulkan/vulkan_beta.h>
+#include "vulkan/vulkan_core.h"
+#include "vulkan_base/vulkan_base.h"
+
+#define ITERATIONS 100
+
+VulkanContext* context;
+
+// Creates and destroys the module ITERATIONS times, returns the average milliseconds per module
+template <typename Create>
+double benchmark(Create create) {
+    vkDestroyShaderModule(context->device, create(), 0);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < ITERATIONS; ++i) {
+        VkShaderModule shaderModule = create();
+        vkDestroyShaderModule(context->device, shaderModule, 0);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count() / ITERATIONS;
+}
+
+int main(int argc, char* argv[]) {
+    const char* instanceExtensions[] = {
+        #ifdef __APPLE__
+        VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME,
+        #endif
+        VK_KHR_PORTABILITY_ENUMERATION_EXTENSION_NAME,
+    };
+    uint32_t instanceExtensionsCount = ARRAY_COUNT(instanceExtensions);
+
+    const char* deviceExtensions[] = {
+        #ifdef __APPLE__
+        VK_KHR_PORTABILITY_SUBSET_EXTENSION_NAME,
+        #endif
+    };
+    uint32_t deviceExtensionsCount = ARRAY_COUNT(deviceExtensions);
+
+    context = initVulkan(instanceExtensionsCount, instanceExtensions, deviceExtensionsCount, deviceExtensions);
+
+    uint32_t shaderCount;
+    const VulkanEmbeddedShader* shaders = getEmbeddedShaders(&shaderCount);
+
+    printf("%-20s %8s %12s %12s\n", "shader", "bytes", "embedded ms", "file ms");
+    double embeddedTotal = 0.0;
+    double fileTotal = 0.0;
+    for (uint32_t i = 0; i < shaderCount; ++i) {
+        const VulkanEmbeddedShader* shader = &shaders[i];
+        std::string filename = std::string("../shaders/") + shader->name;
+
+        double embeddedMs = benchmark([&](){
+            return createShaderModuleFromCode(context, shader->code, shader->size);
+        });
+        double fileMs = benchmark([&](){
+            return createShaderModuleFromFile(context, filename.c_str());
+        });
+        embeddedTotal += embeddedMs;
+        fileTotal += fileMs;
+
+        printf("%-20s %8zu %12.4f %12.4f\n", shader->name, shader->size, embeddedMs, fileMs);
+    }
+    printf("%-20s %8s %12.4f %12.4f\n", "total", "", embeddedTotal, fileTotal);
+
+    exitVulkan(context);
+    return 0;
+}
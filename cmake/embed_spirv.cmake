@@ -0,0 +1,27 @@
+# Writes the SPIR-V words of SPV_FILE as a uint32_t array into OUTPUT_FILE.
+# Usage: cmake -DSPV_FILE=<file.spv> -DOUTPUT_FILE=<file.cpp> -DSYMBOL=<identifier> -P embed_spirv.cmake
+
+file(READ "${SPV_FILE}" spirv HEX)
+string(LENGTH "${spirv}" hexLength)
+math(EXPR remainder "${hexLength} % 8")
+if (hexLength EQUAL 0 OR NOT remainder EQUAL 0)
+    message(FATAL_ERROR "${SPV_FILE} is not a SPIR-V word stream")
+endif()
+
+# glslang writes little endian words, so the bytes of every word are swapped back into a uint32_t literal
+string(REGEX REPLACE "([0-9a-f][0-9a-f])([0-9a-f][0-9a-f])([0-9a-f][0-9a-f])([0-9a-f][0-9a-f])" "0x\\4\\3\\2\\1," words "${spirv}")
+string(REGEX REPLACE "((0x[0-9a-f]+,){8})" "\\1\n    " words "${words}")
+
+file(WRITE "${OUTPUT_FILE}"
+"// Generated from ${SPV_FILE} by cmake/embed_spirv.cmake\n"
+"#include <cstddef>\n"
+"#include <cstdint>\n"
+"\n"
+"extern const uint32_t ${SYMBOL}[];\n"
+"extern const size_t ${SYMBOL}_size;\n"
+"\n"
+"const uint32_t ${SYMBOL}[] = {\n"
+"    ${words}\n"
+"};\n"
+"const size_t ${SYMBOL}_size = sizeof(${SYMBOL});\n"
+)
@@ -1,5 +1,7 @@
+#include <chrono>
 #include <cstdint>
 #include <cstdio>
+#include <cstring>
 #include <iostream>
 #include <stdexcept>
 #include <vulkan/vulkan.h>
@@ -19,13 +21,31 @@ VulkanPipeline pipeline;
 VulkanBuffer ioBuffer;
 VulkanBuffer firstTempBuffer;
 VulkanImage imageBuffer;
+VulkanImage filterImageBuffer;
 size_t imageSize;
+std::vector<uint8_t> inputPixels;
+uint32_t imageWidth;
+uint32_t imageHeight;
 float myData[] = {1, 2, 3, 4, 5};
 
 struct UniformData {
     float offset = 4;
 }uniformData;
 
+void loadInputImage() {
+    int w,h,channels;
+    unsigned char* pixels = stbi_load("../images/image.png", &w, &h, &channels, STBI_rgb_alpha);
+    if (!pixels) {
+        throw std::runtime_error("Failed to load image");
+    }
+    // STBI_rgb_alpha always returns four channels, whatever the file has
+    imageWidth = w;
+    imageHeight = h;
+    imageSize = size_t(w) * h * 4;
+    inputPixels.assign(pixels, pixels + imageSize);
+    stbi_image_free(pixels);
+}
+
 void initApplication() {
 
     const char* instanceExtensions[] = {
@@ -57,6 +77,7 @@ void initApplication() {
     addDescriptorSetLayout(descriptorSetInfo, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
     addDescriptorSetLayout(descriptorSetInfo, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
     addDescriptorSetLayout(descriptorSetInfo, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+    addDescriptorSetLayout(descriptorSetInfo, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
     createDescriptorSet(context, descriptorSetInfo);
 
 
@@ -79,58 +100,64 @@ void initApplication() {
         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
     );
 
-    int w,h,channels;
-    unsigned char* pixels = stbi_load("../images/image.png", &w, &h, &channels, STBI_rgb_alpha);
-    if (!pixels) {
-        throw std::runtime_error("Failed to load image");
-    }
-    imageSize = size_t(w) * h * channels;
-
+    int w = imageWidth;
+    int h = imageHeight;
     descriptorSetInfo->addImageAndData(
         context, 
-        &imageBuffer, pixels, imageSize,
+        &imageBuffer, inputPixels.data(), imageSize,
         w, h, 1, 
         VK_FORMAT_R8G8B8A8_UNORM, 
         VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_STORAGE_BIT, 
         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
     );
-    stbi_image_free(pixels);
+
+    // Second image the neighbourhood filters ping-pong with
+    descriptorSetInfo->addImageAndData(
+        context,
+        &filterImageBuffer, NULL, imageSize,
+        w, h, 1,
+        VK_FORMAT_R8G8B8A8_UNORM,
+        VK_IMAGE_USAGE_STORAGE_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+    );
 
     LOG("Load descriptor set");
     fillDescriptorSet(context, descriptorSetInfo);
 
     LOG("Creating pipeline");
-    std::vector<const char*> computeShaders;
-    computeShaders.push_back("../shaders/test1.spv");
-    computeShaders.push_back("../shaders/test2.spv");
-    computeShaders.push_back("../shaders/test3.spv");
-    std::vector<ivec3> dispatches = {
+    VulkanPipelineStages stages;
+    stages.shaders.push_back("../shaders/test1.spv");
+    stages.shaders.push_back("../shaders/test2.spv");
+    stages.shaders.push_back("../shaders/test3.spv");
+    stages.dispatches = {
         ivec3{5, 1, 1},
         ivec3{1, 1, 1},
         ivec3{(int)w/16+1, (int)h/16+1, 1},
     };
-    pipeline = createPipeline(context, computeShaders, dispatches, descriptorSetInfo);
+    addSeparableFilterStages(&stages, ImageFilter::GAUSSIAN_BLUR, 3, 0.0f, w, h, false);
+    pipeline = createPipeline(context, stages.shaders, stages.dispatches, descriptorSetInfo, 0, stages.specializationConstants);
 }
 
 void shutdownApplication() {
-    vkDeviceWaitIdle(context->device);
-    
-    destroyImage(context, &imageBuffer);
-    destroyBuffer(context, &firstTempBuffer);
-    destroyBuffer(context, &ioBuffer);
-    destroyPipeline(context, &pipeline);
-    destroyDescriptorSet(context, descriptorSetInfo);
-    
+    // Queued resources are destroyed by exitVulkan once the last submission finished
+    deferDestroyImage(context, &imageBuffer);
+    deferDestroyImage(context, &filterImageBuffer);
+    deferDestroyBuffer(context, &firstTempBuffer);
+    deferDestroyBuffer(context, &ioBuffer);
+    deferDestroyPipeline(context, &pipeline);
+    deferDestroyDescriptorSet(context, descriptorSetInfo);
+
     exitVulkan(context);
 }
 
-void runApplication() {
+// Returns the milliseconds from submitting the stages until they finished
+double runApplication() {
     VkCommandBuffer commandBuffer;
     {
         VkCommandBufferAllocateInfo allocInfo{};
         allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
         allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        allocInfo.commandPool = context->commandPool;
+        allocInfo.commandPool = getThreadCommandPool(context);
         allocInfo.commandBufferCount = 1;
         if (vkAllocateCommandBuffers(context->device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
             throw std::runtime_error("failed to allocate command buffer");
@@ -140,55 +167,16 @@ void runApplication() {
     VkCommandBufferBeginInfo beginInfo = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
     vkBeginCommandBuffer(commandBuffer, &beginInfo);
 
-    vkCmdBindDescriptorSets(
-        commandBuffer, 
-        VK_PIPELINE_BIND_POINT_COMPUTE, 
-        pipeline.pipelineLayout, 
-        0, 
-        1, 
-        &descriptorSetInfo->descriptorSet, 
-        0, 
-        0
-    );
-
-    for (int i = 0; i < pipeline.pipelines.size(); ++i) {
-        vkCmdBindPipeline(
-            commandBuffer, 
-            VK_PIPELINE_BIND_POINT_COMPUTE, 
-            pipeline.pipelines[i]
-        );
-
-        ivec3 dispatchSize = pipeline.dispatchSizes[i];
-        vkCmdDispatch(commandBuffer, dispatchSize.x, dispatchSize.y, dispatchSize.z);
-        {
-            VkMemoryBarrier barrier = {VK_STRUCTURE_TYPE_MEMORY_BARRIER};
-            barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
-            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-            vkCmdPipelineBarrier(
-                commandBuffer,
-                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-                0,
-                1, &barrier,
-                0, nullptr,
-                0, nullptr
-            );
-        }
-    }
+    recordPipeline(commandBuffer, &pipeline, descriptorSetInfo);
 
     if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
         throw std::runtime_error("failed to record command buffer!");
     }
 
-    VkSubmitInfo submitInfo = {VK_STRUCTURE_TYPE_SUBMIT_INFO};
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffer;
-
-    if (vkQueueSubmit(context->computeQueue.queue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
-        throw std::runtime_error("failed to submit compute command buffer!");
-    }
-
-    vkQueueWaitIdle(context->computeQueue.queue);
+    auto start = std::chrono::high_resolution_clock::now();
+    uint64_t submission = submitCommandBuffers(context, 1, &commandBuffer, VK_NULL_HANDLE);
+    waitForSubmission(context, submission);
+    auto end = std::chrono::high_resolution_clock::now();
 
     float data[5];
     getDataFromBufferWithStagingBuffer(context, &ioBuffer, data, sizeof(myData));
@@ -199,15 +187,55 @@ void runApplication() {
     }
     std::cout << "]" << std::endl;
 
-    vkFreeCommandBuffers(context->device, context->commandPool, 1, &commandBuffer);
+    vkFreeCommandBuffers(context->device, getThreadCommandPool(context), 1, &commandBuffer);
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// The same stages on the CPU reference backend: test1 and test2 on the buffer, test3 and the blur on the image
+double runCpuReference(CpuThreadPool* pool, float* data, uint8_t* pixels) {
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < ITERATIONS; ++i) {
+        cpuMultiplyAdd(pool, data, sizeof(myData) / sizeof(myData[0]), 5.0f, uniformData.offset);
+        cpuInvertImage(pool, pixels, size_t(imageWidth) * imageHeight);
+        cpuSeparableFilter(pool, pixels, imageWidth, imageHeight, ImageFilter::GAUSSIAN_BLUR, 3, 0.0f);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
 }
 
 
 int main(int argc, char* argv[]) {
+    // --cpu runs the stages on the CPU reference backend only, --compare checks the Vulkan results against it
+    bool cpuOnly = argc > 1 && strcmp(argv[1], "--cpu") == 0;
+    bool compare = argc > 1 && strcmp(argv[1], "--compare") == 0;
+    loadInputImage();
+
+    std::vector<float> cpuData(myData, myData + sizeof(myData) / sizeof(myData[0]));
+    std::vector<uint8_t> cpuPixels = inputPixels;
+    double cpuMs = 0.0;
+    if (cpuOnly || compare) {
+        CpuThreadPool* pool = createCpuThreadPool();
+        cpuMs = runCpuReference(pool, cpuData.data(), cpuPixels.data());
+        destroyCpuThreadPool(pool);
+    }
+    if (cpuOnly) {
+        std::cout << "[" << cpuData[0];
+        for (size_t i = 1; i < cpuData.size(); i++) {
+            std::cout<< ", " << cpuData[i];
+        }
+        std::cout << "]" << std::endl;
+        LOG("CPU reference took " << cpuMs << " ms");
+        if(!stbi_write_png("output_cpu.png", static_cast<int>(imageWidth), static_cast<int>(imageHeight), 4, cpuPixels.data(), imageWidth*4)) {
+            LOG_ERROR("Failed saving output image");
+        }
+        return 1;
+    }
+
     initApplication();
 
+    double gpuMs = 0.0;
     for (int i = 0; i < ITERATIONS; ++i) {
-        runApplication();
+        gpuMs += runApplication();
     }
     std::vector<uint8_t> outputPixels(imageSize);
     getDataFromImageWithStagingBuffer(context, &imageBuffer, outputPixels.data());
@@ -216,6 +244,24 @@ int main(int argc, char* argv[]) {
         LOG_ERROR("Failed saving output image");
     }
 
+    if (compare) {
+        std::vector<float> data(cpuData.size());
+        getDataFromBufferWithStagingBuffer(context, &ioBuffer, data.data(), sizeof(myData));
+
+        // Both results come from the same submissions, so they share the timings. The blur may round differently
+        CpuComparison bufferComparison = {"ioBuffer"};
+        compareFloatResults(&bufferComparison, data.data(), cpuData.data(), data.size(), 1e-5f);
+        bufferComparison.gpuMs = gpuMs;
+        bufferComparison.cpuMs = cpuMs;
+        printCpuComparison(&bufferComparison);
+
+        CpuComparison imageComparison = {"image"};
+        compareByteResults(&imageComparison, outputPixels.data(), cpuPixels.data(), imageSize, 1);
+        imageComparison.gpuMs = gpuMs;
+        imageComparison.cpuMs = cpuMs;
+        printCpuComparison(&imageComparison);
+    }
+
     shutdownApplication();
     return 1;
 }
@@ -1,7 +1,16 @@
 #include "vulkan/vulkan_core.h"
 #include <vulkan/vulkan.h>
 #include <vector>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
 #include <unordered_map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
 
 #define ENABLE_LOGGING 1
 
@@ -28,13 +37,116 @@ struct VulkanQueue {
     uint32_t familyIndex;
 };
 
+// Command pool of one thread with the command buffers and fences that single time commands recycle
+struct VulkanCommandPool {
+    VkCommandPool commandPool;
+    std::vector<VkCommandBuffer> transferCommandBuffers;
+    std::vector<VkFence> transferFences;
+    std::vector<uint32_t> freeTransfers;
+};
+
+// What allocateMemory does when an allocation does not fit into the budget of its heap
+enum class MemoryBudgetPolicy {
+    IGNORE,
+    FAIL,
+    // Calls the eviction callback until the allocation fits or the callback gives up
+    EVICT,
+    // Places device local allocations that do not fit, or that the device has no memory left for, into host memory the device can read
+    HOST_FALLBACK,
+};
+
+struct VulkanContext;
+// Frees resources of the given heap right away (not through the deferred destruction queue), returns false when nothing
+// is left to evict. Eviction stops as well when a call frees nothing in the heap
+typedef bool (*MemoryEvictionCallback)(VulkanContext* context, uint32_t heapIndex, VkDeviceSize bytesNeeded, void* userData);
+
+struct VulkanMemoryStatistics {
+    VkDeviceSize typeLiveBytes[VK_MAX_MEMORY_TYPES];
+    VkDeviceSize typePeakBytes[VK_MAX_MEMORY_TYPES];
+    uint32_t typeLiveAllocations[VK_MAX_MEMORY_TYPES];
+    uint64_t typeTotalAllocations[VK_MAX_MEMORY_TYPES];
+    VkDeviceSize heapLiveBytes[VK_MAX_MEMORY_HEAPS];
+    VkDeviceSize heapPeakBytes[VK_MAX_MEMORY_HEAPS];
+    // Host visible buffers that are only used for transfers
+    uint64_t stagingAllocations;
+    VkDeviceSize stagingBytes;
+    uint64_t failedAllocations;
+    uint64_t evictions;
+    uint64_t hostFallbacks;
+};
+
+struct VulkanMemoryBudget {
+    uint32_t heapCount;
+    VkDeviceSize heapBudget[VK_MAX_MEMORY_HEAPS];
+    VkDeviceSize heapUsage[VK_MAX_MEMORY_HEAPS];
+};
+
+struct VulkanMemoryAllocation {
+    VkDeviceSize size;
+    uint32_t memoryTypeIndex;
+};
+
+struct VulkanMemoryTracker {
+    std::mutex mutex;
+    VkPhysicalDeviceMemoryProperties properties;
+    bool budgetExtensionEnabled;
+    VulkanMemoryStatistics statistics;
+    std::unordered_map<VkDeviceMemory, VulkanMemoryAllocation> allocations;
+    MemoryBudgetPolicy policy;
+    MemoryEvictionCallback evictionCallback;
+    void* evictionUserData;
+};
+
+struct VulkanDeferredDestruction {
+    uint64_t submission;
+    std::function<void()> destroy;
+};
+
+// Every submission on computeQueue gets the next value of a timeline semaphore, or a fence on devices without
+// timeline semaphores. Released resources wait in the deletion queue for the last submission before their release
+struct VulkanSubmissionTracker {
+    VkSemaphore timeline;
+    uint64_t submittedValue;
+    // Fence fallback, guarded by queueMutex like submittedValue
+    std::deque<std::pair<uint64_t, VkFence>> pendingFences;
+    std::vector<VkFence> freeFences;
+    // Threads blocked in vkWaitForFences per fence. Signaled fences with waiters are only reset and recycled by the last one
+    std::unordered_map<VkFence, uint32_t> fenceWaiters;
+    std::vector<VkFence> retiredFences;
+    uint64_t completedValue;
+    std::mutex deletionMutex;
+    std::deque<VulkanDeferredDestruction> deletionQueue;
+};
+
 struct VulkanContext {
     VkInstance instance;
     VkPhysicalDevice physicalDevice;
     VkPhysicalDeviceProperties physicalDeviceProperties;
+    VkPhysicalDeviceSubgroupProperties subgroupProperties;
     VkDevice device;
+    // Device features that were found and enabled in createLogicalDevice
+    bool bindlessSupported;
+    bool bindlessUpdateUnusedWhilePending;
+    bool bufferDeviceAddressSupported;
+    bool timelineSemaphoreSupported;
+    bool storage16BitSupported;
+    bool storage8BitSupported;
+    bool shaderFloat16Supported;
+    bool shaderInt8Supported;
+    bool shaderInt16Supported;
+    // VK_EXT_external_memory_host, imported host memory has to be aligned to minImportedHostPointerAlignment
+    bool hostImportSupported;
+    VkDeviceSize minImportedHostPointerAlignment;
+    PFN_vkGetMemoryHostPointerPropertiesEXT getMemoryHostPointerProperties;
     VulkanQueue computeQueue;
+    // Pool of the thread that called initVulkan, other threads get their own through getThreadCommandPool()
     VkCommandPool commandPool;
+    std::unordered_map<std::thread::id, VulkanCommandPool> threadCommandPools;
+    std::mutex commandPoolMutex;
+    // Every vkQueueSubmit and vkQueueWaitIdle on computeQueue has to hold this lock
+    std::mutex queueMutex;
+    VulkanMemoryTracker memoryTracker;
+    VulkanSubmissionTracker submissions;
 };
 
 struct VulkanBuffer {
@@ -48,15 +160,26 @@ struct VulkanImage {
     VkImageView view;
     VkImageLayout currentLayout;
     VkExtent3D extent;
+    VkFormat format;
+    VkImageUsageFlags usage;
+    uint32_t mipLevels;
     size_t size;
 };
 
+// Private mapping of a whole file, padded with zeros to mappedSize so it can be imported as host memory
+struct VulkanMappedFile {
+    void* data;
+    size_t size;
+    size_t mappedSize;
+};
+
 struct VulkanDescriptorBufferInfo {
     VkDescriptorBufferInfo bufferInfo;
     VkDescriptorImageInfo imageInfo;
     enum class Type {
         BUFFER,
         IMAGE,
+        SAMPLER,
     } type;
 };
 
@@ -84,43 +207,581 @@ struct VulkanDescriptorSet {
         VkImageUsageFlags usage, 
         VkMemoryPropertyFlags memoryProperties
     );
+
+    // Read-only image for texture fetches, pass a sampler for COMBINED_IMAGE_SAMPLER bindings or VK_NULL_HANDLE for SAMPLED_IMAGE
+    void addSampledImageAndData(
+        VulkanContext* context,
+        VulkanImage* image, VkSampler sampler, void* data, size_t size,
+        uint32_t width, uint32_t height, uint32_t depth, uint32_t mipLevels,
+        VkFormat format,
+        VkMemoryPropertyFlags memoryProperties
+    );
+
+    void addSampler(VkSampler sampler);
+};
+
+// Hands out sets of one layout from pools that grow on demand. Sets are written through an update template
+// from an array with one VulkanDescriptorBufferInfo per binding, and are recycled per job or reset per frame
+struct VulkanDescriptorAllocator {
+    std::mutex mutex;
+    VkDescriptorSetLayout descriptorSetLayout;
+    uint32_t bindingCount;
+    std::vector<VkDescriptorPoolSize> setPoolSizes;
+    std::vector<VkDescriptorPool> pools;
+    uint32_t setsPerPool;
+    uint32_t setsLeftInPool;
+    std::vector<VkDescriptorSet> freeSets;
+    VkDescriptorUpdateTemplate updateTemplate;
 };
 
 struct VulkanPipeline {
     std::vector<VkPipeline> pipelines;
     std::vector<ivec3> dispatchSizes;
+    // Stages with an indirect buffer take their group counts from a VkDispatchIndirectCommand on the device instead of dispatchSizes
+    std::vector<VkBuffer> indirectBuffers;
+    std::vector<VkDeviceSize> indirectOffsets;
     VkPipelineLayout pipelineLayout;
+    uint32_t pushConstantSize;
+};
+
+// SPIR-V of shaders/*.comp that the build embeds into vulkan_base, size is in bytes
+struct VulkanEmbeddedShader {
+    const char* name;
+    const uint32_t* code;
+    size_t size;
+};
+
+// Shader list for createPipeline that the image filter helpers append to
+struct VulkanPipelineStages {
+    std::vector<const char*> shaders;
+    std::vector<ivec3> dispatches;
+    std::vector<std::vector<uint32_t>> specializationConstants;
+};
+
+// Values match OPERATION in filter_separable.comp
+enum class ImageFilter {
+    GAUSSIAN_BLUR = 0,
+    BOX_BLUR = 1,
+    ERODE = 2,
+    DILATE = 3,
+};
+
+// Element formats of reduced precision buffers, as float16_t, and as R8_SNORM and R8_UNORM data in shaders
+enum class PackedFormat {
+    FLOAT16,
+    SNORM8,
+    UNORM8,
+};
+
+// One stage of a fused elementwise chain. expression is a GLSL float expression of the element value x, its index i
+// and the stage parameters p0, p1, ..., whose values are passed per run, e.g. "x * 5.0" or "x + p0"
+struct VulkanElementwiseStage {
+    std::string expression;
+    uint32_t parameterCount;
+};
+
+// Runs a whole chain of elementwise stages in one pass, reading every element once and writing it once
+struct VulkanFusedKernel {
+    uint64_t hash;
+    // Generated GLSL, chains whose hashes collide are told apart by it
+    std::string source;
+    uint32_t parameterCount;
+    VulkanPipeline pipeline;
+};
+
+// Fused kernels are generated per chain and compiled with glslangValidator. They are cached by a hash of the chain,
+// in memory and as SPIR-V in cacheDirectory. Kernels read floats from binding 0 and write them to binding 1
+struct VulkanFusionCache {
+    std::mutex mutex;
+    std::string cacheDirectory;
+    VulkanDescriptorSet* descriptorSetInfo;
+    VulkanDescriptorAllocator* descriptorAllocator;
+    std::unordered_multimap<uint64_t, VulkanFusedKernel*> kernels;
+};
+
+// Values are the bindings of the arrays in the bindless descriptor set
+enum class BindlessResource {
+    STORAGE_BUFFER = 0,
+    STORAGE_IMAGE = 1,
+    SAMPLED_IMAGE = 2,
+};
+
+// One update-after-bind descriptor set with an array per resource type. Resources are registered once and
+// shaders pick them by the returned index, which is usually passed in push constants
+struct VulkanBindlessSet {
+    std::mutex mutex;
+    VkDescriptorSetLayout descriptorSetLayout;
+    VkDescriptorPool descriptorPool;
+    VkDescriptorSet descriptorSet;
+    uint32_t capacity[3];
+    uint32_t used[3];
+    std::vector<uint32_t> freeSlots[3];
+};
+
+enum class JobPriority {
+    LOW = 0,
+    NORMAL = 1,
+    HIGH = 2,
+};
+
+// Host data copied into a buffer before the job runs. submitJob() copies the data, so it can be reused once it returns
+struct VulkanJobUpload {
+    VulkanBuffer* buffer;
+    VkDeviceSize offset;
+    const void* data;
+    size_t size;
+};
+
+// Host memory the job writes results to, it is filled before the future of the job becomes ready
+struct VulkanJobDownload {
+    VulkanBuffer* buffer;
+    VkDeviceSize offset;
+    void* data;
+    size_t size;
+};
+
+// One run of a pipeline with its own bindings. Jobs of the same pipeline are compatible and share their
+// dispatches and barriers when they end up in one batch, so queued jobs must not write buffers other queued jobs use
+struct VulkanComputeJob {
+    VulkanPipeline* pipeline;
+    // Hands out the set of the job, its layout has to match the pipeline
+    VulkanDescriptorAllocator* descriptorAllocator;
+    // One entry per binding, e.g. from describeBuffer() and describeImage()
+    std::vector<VulkanDescriptorBufferInfo> resources;
+    // pipeline->pushConstantSize bytes
+    std::vector<uint8_t> pushConstants;
+    std::vector<VulkanJobUpload> uploads;
+    std::vector<VulkanJobDownload> downloads;
+    JobPriority priority;
+};
+
+struct VulkanScheduledJob {
+    VulkanComputeJob job;
+    // Copy of the data of all uploads, in upload order
+    std::vector<uint8_t> uploadData;
+    // Bytes of all uploads and downloads, which batches share one staging buffer for
+    VkDeviceSize stagingSize;
+    std::promise<void> promise;
+};
+
+// Jobs that went into one submission, with the staging memory of their uploads and downloads
+struct VulkanJobBatch {
+    uint64_t submission;
+    VkCommandBuffer commandBuffer;
+    std::vector<VulkanScheduledJob*> jobs;
+    std::vector<VkDescriptorSet> descriptorSets;
+    VulkanBuffer stagingBuffer;
+    VkDeviceSize stagingSize;
+    void* stagingData;
+    // Staging offset of every download, in job order
+    std::vector<VkDeviceSize> downloadOffsets;
+};
+
+// Collects jobs from any thread. The submit thread records the queued jobs by priority into batches of up to
+// maxBatchSize jobs while fewer than maxJobsInFlight are executing, and the retire thread completes their futures
+struct VulkanScheduler {
+    VulkanContext* context;
+    uint32_t maxJobsInFlight;
+    uint32_t maxBatchSize;
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    std::deque<VulkanScheduledJob*> queues[3];
+    std::deque<VulkanJobBatch*> batchesInFlight;
+    uint32_t jobsInFlight;
+    // Command buffers of finished batches, they belong to the pool of the submit thread
+    std::vector<VkCommandBuffer> freeCommandBuffers;
+    uint64_t submittedBatches;
+    uint64_t submittedJobs;
+    bool stopping;
+    bool submitThreadDone;
+    std::thread submitThread;
+    std::thread retireThread;
+};
+
+// Work-stealing pool of the CPU reference backend. Workers pop their own queue from the back and steal from the
+// front of the others, and the thread that calls cpuParallelFor() runs tasks as well until its range is done
+struct CpuWorkQueue {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+};
+
+struct CpuThreadPool {
+    std::vector<std::thread> workers;
+    std::vector<CpuWorkQueue*> queues;
+    std::atomic<int> queuedTasks;
+    std::atomic<uint32_t> nextQueue;
+    std::mutex sleepMutex;
+    std::condition_variable wakeUp;
+    bool stopping;
+};
+
+// Element-wise check of a Vulkan result against the CPU reference, with the timings of both for the speedup
+struct CpuComparison {
+    const char* name;
+    size_t elementCount;
+    size_t mismatches;
+    size_t firstMismatch;
+    double maxError;
+    double gpuMs;
+    double cpuMs;
+};
+
+// Tuned compute building blocks, every call records into one command buffer and waits for it to finish.
+// Buffers hold uint32 elements (floats for reduceSum) and need STORAGE_BUFFER usage, the histogram also TRANSFER_DST
+struct VulkanPrimitives {
+    // Calls share the descriptor allocator and scratch buffers, so they are serialized
+    std::mutex mutex;
+    uint32_t maxElements;
+    bool useSubgroups;
+    VulkanDescriptorSet* descriptorSetInfo;
+    VulkanDescriptorAllocator* descriptorAllocator;
+    VulkanPipeline pipeline;
+    std::vector<VulkanBuffer> scanBlockSums;
+    VulkanBuffer reducePartials[2];
+    VulkanBuffer scanOffsets;
+    VulkanBuffer sortKeys;
+    VulkanBuffer sortValues;
+    VulkanBuffer dummyBuffer;
 };
 
 // vulkan_device.cpp
 VulkanContext* initVulkan(uint32_t extensionCount, const char** extensions, uint32_t deviceExtensionCount, const char** deviceExtensions);
+// Waits for the last submission instead of the whole device, runs the deletion queue and deletes the context
 void exitVulkan(VulkanContext* context);
 
 // vulkan_helper.cpp
 uint32_t findMemoryType(VulkanContext* context, uint32_t typeFilter, VkMemoryPropertyFlags memoryProperties);
+VkCommandPool getThreadCommandPool(VulkanContext* context);
+void releaseThreadCommandPool(VulkanContext* context);
+void destroyThreadCommandPools(VulkanContext* context);
+// Returns the submission value that waitForSubmission() and the deletion queue refer to
+uint64_t submitCommandBuffers(VulkanContext* context, uint32_t commandBufferCount, const VkCommandBuffer* commandBuffers, VkFence fence);
+void waitQueueIdle(VulkanContext* context);
+// Single time commands and secondary command buffers come from the pool of the calling thread and have to be ended there
 VkCommandBuffer beginSingleTimeCommands(VulkanContext* context);
 void endSingleTimeCommands(VulkanContext* context, VkCommandBuffer commandBuffer);
+VkCommandBuffer beginSecondaryCommands(VulkanContext* context);
+void endSecondaryCommands(VkCommandBuffer commandBuffer);
+void executeSecondaryCommands(VkCommandBuffer primaryCommandBuffer, const std::vector<VkCommandBuffer>& secondaryCommandBuffers);
+void freeThreadCommandBuffers(VulkanContext* context, const std::vector<VkCommandBuffer>& commandBuffers);
+
+// vulkan_deferred_destruction.cpp
+void initSubmissionTracker(VulkanContext* context);
+void destroySubmissionTracker(VulkanContext* context);
+uint64_t getCompletedSubmission(VulkanContext* context);
+void waitForSubmission(VulkanContext* context, uint64_t submission);
+// Runs destroy once everything that was submitted up to now has finished executing
+void deferDestruction(VulkanContext* context, std::function<void()> destroy);
+// Runs the entries of finished submissions, every submitCommandBuffers() call does this as well
+void collectDeferredDestructions(VulkanContext* context);
+void flushDeferredDestructions(VulkanContext* context);
+void deferDestroyBuffer(VulkanContext* context, VulkanBuffer* buffer);
+void deferDestroyImage(VulkanContext* context, VulkanImage* image);
+void deferDestroyPipeline(VulkanContext* context, VulkanPipeline* pipeline);
+// Also deletes the object that initDescriptorSet() allocated
+void deferDestroyDescriptorSet(VulkanContext* context, VulkanDescriptorSet* descriptorSet);
+
+// vulkan_memory.cpp
+// All buffer and image memory goes through allocateMemory and freeMemory, which keep the statistics
+void initMemoryTracker(VulkanContext* context);
+VkDeviceMemory allocateMemory(VulkanContext* context, VkMemoryRequirements requirements, VkMemoryPropertyFlags memoryProperties, bool staging, const void* pNext = nullptr);
+void freeMemory(VulkanContext* context, VkDeviceMemory memory);
+void getMemoryStatistics(VulkanContext* context, VulkanMemoryStatistics* statistics);
+// Uses VK_EXT_memory_budget when the device has it, otherwise 80% of every heap minus the tracked allocations
+void getMemoryBudget(VulkanContext* context, VulkanMemoryBudget* budget);
+// Bytes left in the budget of the heap that memory with these properties comes from, e.g. to size batch jobs
+VkDeviceSize getAvailableMemory(VulkanContext* context, VkMemoryPropertyFlags memoryProperties);
+void setMemoryBudgetPolicy(VulkanContext* context, MemoryBudgetPolicy policy, MemoryEvictionCallback evictionCallback = nullptr, void* userData = nullptr);
+void printMemoryStatistics(VulkanContext* context);
 
 // vulkan_buffer.cpp
 void createBuffer(VulkanContext* context, VulkanBuffer* buffer, uint32_t size, VkBufferUsageFlags usage, VkMemoryPropertyFlags memoryProperties);
 void uploadDataToBufferWithStagingBuffer(VulkanContext* context, VulkanBuffer* buffer, void* data, size_t size);
-void getDataFromBufferWithStagingBuffer(VulkanContext* context, VulkanBuffer* buffer, void* data, size_t size);
+// Readbacks go through HOST_CACHED staging memory when the device has it
+void getDataFromBufferWithStagingBuffer(VulkanContext* context, VulkanBuffer* buffer, void* data, size_t size, VkDeviceSize offset = 0);
+void getStridedDataFromBufferWithStagingBuffer(VulkanContext* context, VulkanBuffer* buffer, void* data, size_t elementSize, uint32_t elementCount, VkDeviceSize stride, VkDeviceSize offset = 0);
+void createReadbackBuffer(VulkanContext* context, VulkanBuffer* buffer, VkDeviceSize size);
+void invalidateMappedBuffer(VulkanContext* context, VulkanBuffer* buffer);
+// Convert while the staging buffer is written or read, so only count * getPackedElementSize(format) bytes are transferred
+void uploadPackedDataToBuffer(VulkanContext* context, VulkanBuffer* buffer, const float* data, size_t count, PackedFormat format);
+void getPackedDataFromBuffer(VulkanContext* context, VulkanBuffer* buffer, float* data, size_t count, PackedFormat format, VkDeviceSize offset = 0);
 void destroyBuffer(VulkanContext* context, VulkanBuffer* buffer);
+// The buffer needs VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT usage
+VkDeviceAddress getBufferDeviceAddress(VulkanContext* context, VulkanBuffer* buffer);
+
+// vulkan_host_import.cpp
+// Alignment of host memory the device can import, the page size on devices without VK_EXT_external_memory_host
+VkDeviceSize getHostImportAlignment(VulkanContext* context);
+// Aligned and padded to getHostImportAlignment(), free it after every buffer that wraps it has been destroyed
+void* allocateHostImportMemory(VulkanContext* context, size_t size);
+void freeHostImportMemory(void* memory);
+// Wraps the host memory as a buffer that the device reads and writes in place, the memory has to be aligned and padded
+// like allocateHostImportMemory() does and stay alive until the buffer is destroyed. Otherwise, or without the extension,
+// the data is copied into a device local buffer through a staging buffer and later changes on either side are not shared.
+// Returns whether the memory was imported
+bool importHostBuffer(VulkanContext* context, VulkanBuffer* buffer, void* hostPointer, size_t size, VkBufferUsageFlags usage);
+// Device writes to an imported file stay in the private mapping and never reach the file
+void mapFileForImport(VulkanContext* context, VulkanMappedFile* file, const char* filename);
+bool importFileBuffer(VulkanContext* context, VulkanBuffer* buffer, VulkanMappedFile* file, VkBufferUsageFlags usage);
+void unmapFile(VulkanMappedFile* file);
 
 // vulkan_image.cpp
-void createImage(VulkanContext* context, VulkanImage* image, size_t size, uint32_t width, uint32_t height, uint32_t depth, VkFormat format, VkImageUsageFlags usage, VkMemoryPropertyFlags memoryProperties);
+void createImage(VulkanContext* context, VulkanImage* image, size_t size, uint32_t width, uint32_t height, uint32_t depth, uint32_t mipLevels, VkFormat format, VkImageUsageFlags usage, VkMemoryPropertyFlags memoryProperties);
 void uploadDataToImageWithStagingBuffer(VulkanContext* context, VulkanImage* image, void* data);
 void transitionLayout(VulkanContext* context, VulkanImage* image, VkImageLayout newLayout, VkCommandBuffer commandBuffer);
+VkImageLayout getShaderImageLayout(VulkanImage* image);
 void getDataFromImageWithStagingBuffer(VulkanContext* context, VulkanImage* image, void* data);
+// Reads a region of mip level 0, the texels arrive tightly packed row by row
+void getImageRegionWithStagingBuffer(VulkanContext* context, VulkanImage* image, void* data, VkOffset3D offset, VkExtent3D extent);
 void destroyImage(VulkanContext* context, VulkanImage* image);
+uint32_t calculateMipLevels(uint32_t width, uint32_t height);
+// Bytes per texel of uncompressed color formats, throws for any other format
+uint32_t getFormatTexelSize(VkFormat format);
+// E.g. for R16G16B16A16_SFLOAT or R8G8B8A8_SNORM images with data from packFloats()
+bool supportsStorageImageFormat(VulkanContext* context, VkFormat format);
+VkSampler createSampler(VulkanContext* context, VkFilter filter, VkSamplerAddressMode addressMode, uint32_t mipLevels);
+void destroySampler(VulkanContext* context, VkSampler sampler);
 
 // vulkan_descriptor_set.cpp
 VulkanDescriptorSet* initDescriptorSet();
 void addDescriptorSetLayout(VulkanDescriptorSet* descriptorSet, VkDescriptorType descriptorType);
+void createDescriptorSetLayout(VulkanContext* context, VulkanDescriptorSet* descriptorSet);
 void createDescriptorSet(VulkanContext* context, VulkanDescriptorSet* descriptorSet);
 void fillDescriptorSet(VulkanContext* context, VulkanDescriptorSet* descriptorSet);
 void destroyDescriptorSet(VulkanContext* context, VulkanDescriptorSet* descriptorSet);
 
+// vulkan_descriptor_allocator.cpp
+// Uses the layout of descriptorSet, which has to outlive the allocator
+VulkanDescriptorAllocator* createDescriptorAllocator(VulkanContext* context, VulkanDescriptorSet* descriptorSet, uint32_t initialSetsPerPool);
+VkDescriptorSet allocateJobDescriptorSet(VulkanContext* context, VulkanDescriptorAllocator* allocator);
+// resources holds one entry per binding, e.g. from describeBuffer() and describeImage()
+void updateJobDescriptorSet(VulkanContext* context, VulkanDescriptorAllocator* allocator, VkDescriptorSet descriptorSet, const VulkanDescriptorBufferInfo* resources);
+// Only for sets whose command buffers have finished executing
+void releaseJobDescriptorSet(VulkanDescriptorAllocator* allocator, VkDescriptorSet descriptorSet);
+void resetDescriptorAllocator(VulkanContext* context, VulkanDescriptorAllocator* allocator);
+void destroyDescriptorAllocator(VulkanContext* context, VulkanDescriptorAllocator* allocator);
+VulkanDescriptorBufferInfo describeBuffer(VulkanBuffer* buffer, VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE);
+VulkanDescriptorBufferInfo describeImage(VulkanImage* image, VkSampler sampler = VK_NULL_HANDLE);
+
+// embedded_shaders.cpp, generated by CMake
+const VulkanEmbeddedShader* getEmbeddedShaders(uint32_t* count);
+const VulkanEmbeddedShader* findEmbeddedShader(const char* shaderFilename);
+
 // vulkan_pipeline.cpp
-VulkanPipeline createPipeline(VulkanContext* context, std::vector<const char*> computeShaderFilenames, std::vector<ivec3> dispatches, VulkanDescriptorSet* descriptorSet);
+// Shader filenames are looked up in the embedded shaders first and only loaded from disk when they are not embedded
+VkShaderModule createShaderModule(VulkanContext* context, const char* shaderFilename);
+VkShaderModule createShaderModuleFromCode(VulkanContext* context, const uint32_t* code, size_t size);
+VkShaderModule createShaderModuleFromFile(VulkanContext* context, const char* shaderFilename);
+VulkanPipeline createPipeline(VulkanContext* context, std::vector<const char*> computeShaderFilenames, std::vector<ivec3> dispatches, VulkanDescriptorSet* descriptorSet, uint32_t pushConstantSize = 0, std::vector<std::vector<uint32_t>> specializationConstants = {});
+void setIndirectDispatch(VulkanPipeline* pipeline, uint32_t stage, VulkanBuffer* buffer, VkDeviceSize offset);
+void recordPipeline(VkCommandBuffer commandBuffer, VulkanPipeline* pipeline, VulkanDescriptorSet* descriptorSet);
+// Records every stage for all sets of independent jobs, with one barrier per stage instead of one per job and stage.
+// pushConstants holds pipeline->pushConstantSize bytes per set and may be null for pipelines without push constants
+void recordPipelineBatch(VkCommandBuffer commandBuffer, VulkanPipeline* pipeline, uint32_t setCount, const VkDescriptorSet* descriptorSets, const void* const* pushConstants);
+VulkanPipeline createBindlessPipeline(VulkanContext* context, std::vector<const char*> computeShaderFilenames, std::vector<ivec3> dispatches, VulkanBindlessSet* bindlessSet, uint32_t pushConstantSize, std::vector<std::vector<uint32_t>> specializationConstants = {});
+// Records one stage with its own push constants, e.g. the bindless indices and buffer addresses of a job
+void recordBindlessStage(VkCommandBuffer commandBuffer, VulkanPipeline* pipeline, uint32_t stage, VulkanBindlessSet* bindlessSet, const void* pushConstants);
 void destroyPipeline(VulkanContext* context, VulkanPipeline* pipeline);
+
+// vulkan_bindless.cpp
+VulkanBindlessSet* createBindlessSet(VulkanContext* context, uint32_t maxStorageBuffers, uint32_t maxStorageImages, uint32_t maxSampledImages);
+uint32_t registerBindlessBuffer(VulkanContext* context, VulkanBindlessSet* bindlessSet, VulkanBuffer* buffer, VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE);
+// Images have to be in their shader layout already (see getShaderImageLayout)
+uint32_t registerBindlessImage(VulkanContext* context, VulkanBindlessSet* bindlessSet, VulkanImage* image);
+uint32_t registerBindlessSampledImage(VulkanContext* context, VulkanBindlessSet* bindlessSet, VulkanImage* image, VkSampler sampler);
+// The slot may be handed out again right away, so no job that is still executing may use it
+void releaseBindlessSlot(VulkanBindlessSet* bindlessSet, BindlessResource resource, uint32_t index);
+void destroyBindlessSet(VulkanContext* context, VulkanBindlessSet* bindlessSet);
+
+// vulkan_iterative_run.cpp
+// Runs the pipeline in batches of checkInterval iterations. The last iteration of every batch clears statusBuffer,
+// runs the convergence pipeline (optional, the check may also be a stage of pipeline) which counts the elements
+// that have not converged yet into its first uint, and copies that word back. The run stops once a zero is read.
+// Statuses are read while the next batch executes, so up to checkInterval more iterations may have run than the
+// converged one. statusBuffer needs STORAGE_BUFFER, TRANSFER_SRC and TRANSFER_DST usage. Returns the iterations run
+uint32_t runUntilConverged(
+    VulkanContext* context,
+    VulkanPipeline* pipeline, VulkanPipeline* convergencePipeline, VulkanDescriptorSet* descriptorSet,
+    VulkanBuffer* statusBuffer, uint32_t maxIterations, uint32_t checkInterval, bool* converged
+);
+
+// vulkan_precision.cpp
+size_t getPackedElementSize(PackedFormat format);
+// Float16 rounds to nearest even, the 8-bit formats clamp to their range first
+void packFloats(PackedFormat format, const float* input, void* output, size_t count);
+void unpackFloats(PackedFormat format, const void* input, float* output, size_t count);
+
+// vulkan_fusion.cpp
+// cacheDirectory has to exist, the generated .comp and .spv files of every chain are kept there across runs
+// cacheDirectory has to exist and be writable, e.g. a directory in the build tree rather than the working directory
+VulkanFusionCache* createFusionCache(VulkanContext* context, const char* cacheDirectory);
+VulkanFusedKernel* getFusedKernel(VulkanContext* context, VulkanFusionCache* cache, const std::vector<VulkanElementwiseStage>& stages);
+// Input and output may be the same buffer, release the set with releaseJobDescriptorSet(cache->descriptorAllocator, set)
+VkDescriptorSet allocateFusedDescriptorSet(VulkanContext* context, VulkanFusionCache* cache, VulkanBuffer* input, VulkanBuffer* output);
+// parameters holds the values of all stages in chain order
+void recordFusedKernel(VkCommandBuffer commandBuffer, VulkanFusedKernel* kernel, VkDescriptorSet descriptorSet, uint32_t count, const float* parameters);
+void runFusedKernel(VulkanContext* context, VulkanFusionCache* cache, const std::vector<VulkanElementwiseStage>& stages, VulkanBuffer* input, VulkanBuffer* output, uint32_t count, const std::vector<float>& parameters);
+void destroyFusionCache(VulkanContext* context, VulkanFusionCache* cache);
+
+// vulkan_scheduler.cpp
+VulkanScheduler* createScheduler(VulkanContext* context, uint32_t maxJobsInFlight, uint32_t maxBatchSize);
+// Thread-safe. The future throws when the job could not be recorded or submitted
+std::future<void> submitJob(VulkanScheduler* scheduler, VulkanComputeJob job);
+// Runs all queued jobs and waits for them before it stops the threads
+void destroyScheduler(VulkanScheduler* scheduler);
+
+// vulkan_cpu_reference.cpp
+// CPU versions of the sample stages and the primitives with the same results, vectorized with SSE2 or NEON
+CpuThreadPool* createCpuThreadPool(uint32_t threadCount = 0);
+void destroyCpuThreadPool(CpuThreadPool* pool);
+void cpuParallelFor(CpuThreadPool* pool, size_t count, size_t grainSize, const std::function<void(size_t begin, size_t end)>& body);
+// data = data * factor + offset, test1.comp is (5, 0) and test2.comp is (1, offset)
+void cpuMultiplyAdd(CpuThreadPool* pool, float* data, size_t count, float factor, float offset);
+// test3.comp on rgba8 pixels
+void cpuInvertImage(CpuThreadPool* pool, uint8_t* pixels, size_t pixelCount);
+// Both passes of addSeparableFilterStages() on rgba8 pixels, rounding in between like the storage image does
+void cpuSeparableFilter(CpuThreadPool* pool, uint8_t* pixels, uint32_t width, uint32_t height, ImageFilter filter, uint32_t radius, float sigma);
+float cpuReduceSum(CpuThreadPool* pool, const float* input, size_t count);
+void cpuPrefixSum(CpuThreadPool* pool, const uint32_t* input, uint32_t* output, size_t count, bool inclusive);
+void cpuHistogram(CpuThreadPool* pool, const uint32_t* input, uint32_t* histogram, size_t count, uint32_t binCount, uint32_t shift);
+// Returns the number of elements written to output
+uint32_t cpuCompact(CpuThreadPool* pool, const uint32_t* input, const uint32_t* flags, uint32_t* output, size_t count);
+void cpuRadixSortPairs(CpuThreadPool* pool, uint32_t* keys, uint32_t* values, size_t count);
+// Elements differing by more than tolerance (relative to the reference for floats) count as mismatches
+void compareFloatResults(CpuComparison* comparison, const float* gpu, const float* cpu, size_t count, float tolerance);
+void compareUintResults(CpuComparison* comparison, const uint32_t* gpu, const uint32_t* cpu, size_t count);
+void compareByteResults(CpuComparison* comparison, const uint8_t* gpu, const uint8_t* cpu, size_t count, uint8_t tolerance);
+void printCpuComparison(const CpuComparison* comparison);
+
+// vulkan_image_filters.cpp
+// Filters ping-pong between the rgba8 storage images at binding 2 and 3 of the shared descriptor set.
+// Separable filters end up in the image they read from, the Sobel stage writes into the other one
+void addSeparableFilterStages(VulkanPipelineStages* stages, ImageFilter filter, uint32_t radius, float sigma, uint32_t width, uint32_t height, bool readFromSecond);
+void addSobelStage(VulkanPipelineStages* stages, uint32_t width, uint32_t height, bool readFromSecond);
+
+// vulkan_primitives.cpp
+VulkanPrimitives* initPrimitives(VulkanContext* context, uint32_t maxElements);
+void destroyPrimitives(VulkanContext* context, VulkanPrimitives* primitives);
+// Writes 0.0 for a count of 0, which needs TRANSFER_DST usage on output
+void reduceSum(VulkanContext* context, VulkanPrimitives* primitives, VulkanBuffer* input, VulkanBuffer* output, uint32_t count);
+void prefixSum(VulkanContext* context, VulkanPrimitives* primitives, VulkanBuffer* input, VulkanBuffer* output, uint32_t count, bool inclusive);
+void computeHistogram(VulkanContext* context, VulkanPrimitives* primitives, VulkanBuffer* input, VulkanBuffer* histogram, uint32_t count, uint32_t binCount, uint32_t shift);
+// With a dispatchGroupSize, outputCount also receives a VkDispatchIndirectCommand at offset 4 that covers the surviving elements.
+// outputCount needs VK_BUFFER_USAGE_TRANSFER_DST_BIT, it is cleared with vkCmdFillBuffer when count is 0
+void compactBuffer(VulkanContext* context, VulkanPrimitives* primitives, VulkanBuffer* input, VulkanBuffer* flags, VulkanBuffer* output, VulkanBuffer* outputCount, uint32_t count, uint32_t dispatchGroupSize = 0);
+void radixSortPairs(VulkanContext* context, VulkanPrimitives* primitives, VulkanBuffer* keys, VulkanBuffer* values, uint32_t count);
+
+// Move-only owners that hand their resource to the deletion queue when they go out of scope or are reassigned,
+// so a service can swap the buffers of a job while earlier jobs still read the old ones
+template <typename T, void (*DeferDestroy)(VulkanContext*, T*)>
+class VulkanHandle {
+public:
+    VulkanHandle() : context(nullptr), object() {}
+    VulkanHandle(VulkanContext* context, T object) : context(context), object(std::move(object)) {}
+    VulkanHandle(VulkanHandle&& other) : context(other.context), object(std::move(other.object)) {
+        other.context = nullptr;
+    }
+    VulkanHandle& operator=(VulkanHandle&& other) {
+        if (this != &other) {
+            reset();
+            context = other.context;
+            object = std::move(other.object);
+            other.context = nullptr;
+        }
+        return *this;
+    }
+    VulkanHandle(const VulkanHandle&) = delete;
+    VulkanHandle& operator=(const VulkanHandle&) = delete;
+    ~VulkanHandle() { reset(); }
+
+    T* get() { return &object; }
+    T* operator->() { return &object; }
+    T& operator*() { return object; }
+    explicit operator bool() const { return context != nullptr; }
+
+    void reset() {
+        if (context != nullptr) {
+            DeferDestroy(context, &object);
+            context = nullptr;
+        }
+    }
+
+private:
+    VulkanContext* context;
+    T object;
+};
+
+typedef VulkanHandle<VulkanBuffer, deferDestroyBuffer> VulkanBufferHandle;
+typedef VulkanHandle<VulkanImage, deferDestroyImage> VulkanImageHandle;
+typedef VulkanHandle<VulkanPipeline, deferDestroyPipeline> VulkanPipelineHandle;
+
+class VulkanDescriptorSetHandle {
+public:
+    VulkanDescriptorSetHandle() : context(nullptr), descriptorSet(nullptr) {}
+    VulkanDescriptorSetHandle(VulkanContext* context, VulkanDescriptorSet* descriptorSet) : context(context), descriptorSet(descriptorSet) {}
+    VulkanDescriptorSetHandle(VulkanDescriptorSetHandle&& other) : context(other.context), descriptorSet(other.descriptorSet) {
+        other.descriptorSet = nullptr;
+    }
+    VulkanDescriptorSetHandle& operator=(VulkanDescriptorSetHandle&& other) {
+        if (this != &other) {
+            reset();
+            context = other.context;
+            descriptorSet = other.descriptorSet;
+            other.descriptorSet = nullptr;
+        }
+        return *this;
+    }
+    VulkanDescriptorSetHandle(const VulkanDescriptorSetHandle&) = delete;
+    VulkanDescriptorSetHandle& operator=(const VulkanDescriptorSetHandle&) = delete;
+    ~VulkanDescriptorSetHandle() { reset(); }
+
+    VulkanDescriptorSet* get() { return descriptorSet; }
+    VulkanDescriptorSet* operator->() { return descriptorSet; }
+    explicit operator bool() const { return descriptorSet != nullptr; }
+
+    void reset() {
+        if (descriptorSet != nullptr) {
+            deferDestroyDescriptorSet(context, descriptorSet);
+            descriptorSet = nullptr;
+        }
+    }
+
+private:
+    VulkanContext* context;
+    VulkanDescriptorSet* descriptorSet;
+};
+
+// Declare it before the other handles of the context, so it calls exitVulkan() after they queued their resources
+class VulkanContextHandle {
+public:
+    VulkanContextHandle() : context(nullptr) {}
+    explicit VulkanContextHandle(VulkanContext* context) : context(context) {}
+    VulkanContextHandle(VulkanContextHandle&& other) : context(other.context) {
+        other.context = nullptr;
+    }
+    VulkanContextHandle& operator=(VulkanContextHandle&& other) {
+        if (this != &other) {
+            reset();
+            context = other.context;
+            other.context = nullptr;
+        }
+        return *this;
+    }
+    VulkanContextHandle(const VulkanContextHandle&) = delete;
+    VulkanContextHandle& operator=(const VulkanContextHandle&) = delete;
+    ~VulkanContextHandle() { reset(); }
+
+    VulkanContext* get() { return context; }
+    VulkanContext* operator->() { return context; }
+    explicit operator bool() const { return context != nullptr; }
+
+    void reset() {
+        if (context != nullptr) {
+            exitVulkan(context);
+            context = nullptr;
+        }
+    }
+
+private:
+    VulkanContext* context;
+};
@@ -0,0 +1,195 @@
+#include "vulkan/vulkan_core.h"
+#include "vulkan_base.h"
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+VulkanBindlessSet* createBindlessSet(VulkanContext* context, uint32_t maxStorageBuffers, uint32_t maxStorageImages, uint32_t maxSampledImages) {
+    if (!context->bindlessSupported) {
+        throw std::runtime_error("descriptor indexing with update after bind is not supported by the device");
+    }
+
+    VkPhysicalDeviceDescriptorIndexingProperties indexingProperties = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES};
+    VkPhysicalDeviceProperties2 properties2 = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2};
+    properties2.pNext = &indexingProperties;
+    vkGetPhysicalDeviceProperties2(context->physicalDevice, &properties2);
+
+    // The layout has to fit the per set limits and the compute pipeline the per stage ones.
+    // Combined image samplers count as sampled images and as samplers
+    uint32_t storageBufferLimit = std::min(
+        indexingProperties.maxDescriptorSetUpdateAfterBindStorageBuffers,
+        indexingProperties.maxPerStageDescriptorUpdateAfterBindStorageBuffers
+    );
+    uint32_t storageImageLimit = std::min(
+        indexingProperties.maxDescriptorSetUpdateAfterBindStorageImages,
+        indexingProperties.maxPerStageDescriptorUpdateAfterBindStorageImages
+    );
+    uint32_t sampledImageLimit = std::min(
+        std::min(indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages, indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages),
+        std::min(indexingProperties.maxDescriptorSetUpdateAfterBindSamplers, indexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers)
+    );
+
+    VulkanBindlessSet* bindlessSet = new VulkanBindlessSet;
+    bindlessSet->capacity[(int)BindlessResource::STORAGE_BUFFER] = std::min(maxStorageBuffers, storageBufferLimit);
+    bindlessSet->capacity[(int)BindlessResource::STORAGE_IMAGE] = std::min(maxStorageImages, storageImageLimit);
+    bindlessSet->capacity[(int)BindlessResource::SAMPLED_IMAGE] = std::min(maxSampledImages, sampledImageLimit);
+    // All arrays together also have to fit the per stage resource limit, which is often below the sum of the others
+    uint64_t totalCapacity = 0;
+    for (int i = 0; i < 3; ++i) {
+        totalCapacity += bindlessSet->capacity[i];
+    }
+    uint64_t resourceLimit = indexingProperties.maxPerStageUpdateAfterBindResources;
+    if (totalCapacity > resourceLimit) {
+        for (int i = 0; i < 3; ++i) {
+            bindlessSet->capacity[i] = static_cast<uint32_t>(bindlessSet->capacity[i] * resourceLimit / totalCapacity);
+        }
+    }
+    for (int i = 0; i < 3; ++i) {
+        bindlessSet->used[i] = 0;
+    }
+    if (bindlessSet->capacity[(int)BindlessResource::STORAGE_BUFFER] < maxStorageBuffers ||
+        bindlessSet->capacity[(int)BindlessResource::STORAGE_IMAGE] < maxStorageImages ||
+        bindlessSet->capacity[(int)BindlessResource::SAMPLED_IMAGE] < maxSampledImages) {
+        LOG_WARN("bindless set was clamped to the per set, per stage and total resource update after bind limits of the device");
+    }
+
+    const VkDescriptorType descriptorTypes[3] = {
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+    };
+
+    // Unused slots stay unwritten, and with UPDATE_UNUSED_WHILE_PENDING new resources can be registered while jobs run
+    VkDescriptorBindingFlags bindingFlag = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+    if (context->bindlessUpdateUnusedWhilePending) {
+        bindingFlag |= VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+    }
+
+    VkDescriptorSetLayoutBinding bindings[3];
+    VkDescriptorBindingFlags bindingFlags[3];
+    std::vector<VkDescriptorPoolSize> poolSizes;
+    for (uint32_t i = 0; i < 3; ++i) {
+        bindings[i] = {};
+        bindings[i].binding = i;
+        bindings[i].descriptorType = descriptorTypes[i];
+        bindings[i].descriptorCount = bindlessSet->capacity[i];
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        bindingFlags[i] = bindingFlag;
+        if (bindlessSet->capacity[i] > 0) {
+            poolSizes.push_back({descriptorTypes[i], bindlessSet->capacity[i]});
+        }
+    }
+    if (poolSizes.empty()) {
+        delete bindlessSet;
+        throw std::runtime_error("bindless set needs at least one resource slot");
+    }
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo = {VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO};
+    bindingFlagsInfo.bindingCount = 3;
+    bindingFlagsInfo.pBindingFlags = bindingFlags;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
+    layoutInfo.pNext = &bindingFlagsInfo;
+    layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+    layoutInfo.bindingCount = 3;
+    layoutInfo.pBindings = bindings;
+    if (vkCreateDescriptorSetLayout(context->device, &layoutInfo, 0, &bindlessSet->descriptorSetLayout) != VK_SUCCESS) {
+        delete bindlessSet;
+        throw std::runtime_error("failed to create bindless descriptor set layout!");
+    }
+
+    VkDescriptorPoolCreateInfo poolInfo = {VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
+    poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+    poolInfo.maxSets = 1;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    if (vkCreateDescriptorPool(context->device, &poolInfo, 0, &bindlessSet->descriptorPool) != VK_SUCCESS) {
+        vkDestroyDescriptorSetLayout(context->device, bindlessSet->descriptorSetLayout, 0);
+        delete bindlessSet;
+        throw std::runtime_error("failed to create bindless descriptor pool!");
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo = {VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
+    allocInfo.descriptorPool = bindlessSet->descriptorPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &bindlessSet->descriptorSetLayout;
+    if (vkAllocateDescriptorSets(context->device, &allocInfo, &bindlessSet->descriptorSet) != VK_SUCCESS) {
+        destroyBindlessSet(context, bindlessSet);
+        throw std::runtime_error("failed to allocate bindless descriptor set!");
+    }
+
+    return bindlessSet;
+}
+
+// Takes a released slot first so the arrays stay dense, the caller holds the mutex of the set
+static uint32_t allocateBindlessSlot(VulkanBindlessSet* bindlessSet, BindlessResource resource) {
+    int type = (int)resource;
+    if (!bindlessSet->freeSlots[type].empty()) {
+        uint32_t index = bindlessSet->freeSlots[type].back();
+        bindlessSet->freeSlots[type].pop_back();
+        return index;
+    }
+    if (bindlessSet->used[type] >= bindlessSet->capacity[type]) {
+        throw std::runtime_error("bindless set is full");
+    }
+    return bindlessSet->used[type]++;
+}
+
+static void writeBindlessSlot(VulkanContext* context, VulkanBindlessSet* bindlessSet, BindlessResource resource, uint32_t index, VkDescriptorType descriptorType, VkDescriptorBufferInfo* bufferInfo, VkDescriptorImageInfo* imageInfo) {
+    VkWriteDescriptorSet write = {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+    write.dstSet = bindlessSet->descriptorSet;
+    write.dstBinding = (uint32_t)resource;
+    write.dstArrayElement = index;
+    write.descriptorCount = 1;
+    write.descriptorType = descriptorType;
+    write.pBufferInfo = bufferInfo;
+    write.pImageInfo = imageInfo;
+    vkUpdateDescriptorSets(context->device, 1, &write, 0, 0);
+}
+
+uint32_t registerBindlessBuffer(VulkanContext* context, VulkanBindlessSet* bindlessSet, VulkanBuffer* buffer, VkDeviceSize offset, VkDeviceSize range) {
+    VkDescriptorBufferInfo bufferInfo = {buffer->buffer, offset, range};
+
+    std::lock_guard<std::mutex> lock(bindlessSet->mutex);
+    uint32_t index = allocateBindlessSlot(bindlessSet, BindlessResource::STORAGE_BUFFER);
+    writeBindlessSlot(context, bindlessSet, BindlessResource::STORAGE_BUFFER, index, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufferInfo, nullptr);
+    return index;
+}
+
+uint32_t registerBindlessImage(VulkanContext* context, VulkanBindlessSet* bindlessSet, VulkanImage* image) {
+    if (!(image->usage & VK_IMAGE_USAGE_STORAGE_BIT)) {
+        throw std::runtime_error("bindless storage images need VK_IMAGE_USAGE_STORAGE_BIT");
+    }
+    VkDescriptorImageInfo imageInfo = {VK_NULL_HANDLE, image->view, getShaderImageLayout(image)};
+
+    std::lock_guard<std::mutex> lock(bindlessSet->mutex);
+    uint32_t index = allocateBindlessSlot(bindlessSet, BindlessResource::STORAGE_IMAGE);
+    writeBindlessSlot(context, bindlessSet, BindlessResource::STORAGE_IMAGE, index, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, nullptr, &imageInfo);
+    return index;
+}
+
+uint32_t registerBindlessSampledImage(VulkanContext* context, VulkanBindlessSet* bindlessSet, VulkanImage* image, VkSampler sampler) {
+    if (sampler == VK_NULL_HANDLE) {
+        throw std::runtime_error("bindless sampled images need a sampler");
+    }
+    VkDescriptorImageInfo imageInfo = {sampler, image->view, getShaderImageLayout(image)};
+
+    std::lock_guard<std::mutex> lock(bindlessSet->mutex);
+    uint32_t index = allocateBindlessSlot(bindlessSet, BindlessResource::SAMPLED_IMAGE);
+    writeBindlessSlot(context, bindlessSet, BindlessResource::SAMPLED_IMAGE, index, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, nullptr, &imageInfo);
+    return index;
+}
+
+void releaseBindlessSlot(VulkanBindlessSet* bindlessSet, BindlessResource resource, uint32_t index) {
+    std::lock_guard<std::mutex> lock(bindlessSet->mutex);
+    if (index >= bindlessSet->used[(int)resource]) {
+        throw std::runtime_error("released a bindless slot that was never registered");
+    }
+    bindlessSet->freeSlots[(int)resource].push_back(index);
+}
+
+void destroyBindlessSet(VulkanContext* context, VulkanBindlessSet* bindlessSet) {
+    vkDestroyDescriptorPool(context->device, bindlessSet->descriptorPool, 0);
+    vkDestroyDescriptorSetLayout(context->device, bindlessSet->descriptorSetLayout, 0);
+    delete bindlessSet;
+}
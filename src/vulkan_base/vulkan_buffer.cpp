@@ -1,6 +1,7 @@
 #include "vulkan/vulkan_core.h"
 #include "vulkan_base.h"
 #include <cstring>
+#include <stdexcept>
 
 void createBuffer(VulkanContext* context, VulkanBuffer* buffer, uint32_t size, VkBufferUsageFlags usage, VkMemoryPropertyFlags memoryProperties) {
     VkBufferCreateInfo createInfo = {VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
@@ -10,13 +11,29 @@ void createBuffer(VulkanContext* context, VulkanBuffer* buffer, uint32_t size, V
 
     VkMemoryRequirements memoryRequirements;
     vkGetBufferMemoryRequirements(context->device, buffer->buffer, &memoryRequirements);
-    uint32_t memoryIndex = findMemoryType(context, memoryRequirements.memoryTypeBits, memoryProperties);
 
-    VkMemoryAllocateInfo allocateInfo = {VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO};
-    allocateInfo.allocationSize = memoryRequirements.size;
-    allocateInfo.memoryTypeIndex = memoryIndex;
-
-    vkAllocateMemory(context->device, &allocateInfo, 0, &buffer->memory);
+    VkMemoryAllocateFlagsInfo allocateFlags = {VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO};
+    if (usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) {
+        if (!context->bufferDeviceAddressSupported) {
+            throw std::runtime_error("buffer device addresses are not supported by the device");
+        }
+        allocateFlags.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT;
+    }
+
+    bool staging = (usage & ~(VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT)) == 0 &&
+        (memoryProperties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+    try {
+        buffer->memory = allocateMemory(
+            context,
+            memoryRequirements,
+            memoryProperties,
+            staging,
+            allocateFlags.flags ? &allocateFlags : nullptr
+        );
+    } catch (const std::runtime_error&) {
+        vkDestroyBuffer(context->device, buffer->buffer, 0);
+        throw;
+    }
     vkBindBufferMemory(context->device, buffer->buffer, buffer->memory, 0);
 }
 
@@ -30,50 +47,147 @@ void copyBuffer(VulkanContext* context, VulkanBuffer* srcBuffer, VulkanBuffer* d
     endSingleTimeCommands(context, commandBuffer);
 }
 
-void uploadDataToBufferWithStagingBuffer(VulkanContext* context, VulkanBuffer* buffer, void* data, size_t size) {
+// fill writes the size bytes of the mapped staging buffer
+static void uploadWithStagingBuffer(VulkanContext* context, VulkanBuffer* buffer, size_t size, const std::function<void(void*)>& fill) {
+    if (size > UINT32_MAX) {
+        throw std::runtime_error("upload over 4 GiB does not fit into one staging buffer");
+    }
     VulkanBuffer stagingBuffer;
     createBuffer(
         context, 
-        &stagingBuffer, size, 
+        &stagingBuffer, static_cast<uint32_t>(size), 
         VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
     );
 
     void* mapped;
     vkMapMemory(context->device, stagingBuffer.memory, 0, size, 0, &mapped);
-    memcpy(mapped, data, size);
+    fill(mapped);
     vkUnmapMemory(context->device, stagingBuffer.memory);
 
     copyBuffer(context, &stagingBuffer, buffer, size);
 
-    vkDestroyBuffer(context->device, stagingBuffer.buffer, 0);
-    vkFreeMemory(context->device, stagingBuffer.memory, 0);
+    destroyBuffer(context, &stagingBuffer);
+}
+
+void uploadDataToBufferWithStagingBuffer(VulkanContext* context, VulkanBuffer* buffer, void* data, size_t size) {
+    uploadWithStagingBuffer(context, buffer, size, [data, size](void* mapped) {
+        memcpy(mapped, data, size);
+    });
+}
+
+void uploadPackedDataToBuffer(VulkanContext* context, VulkanBuffer* buffer, const float* data, size_t count, PackedFormat format) {
+    uploadWithStagingBuffer(context, buffer, count * getPackedElementSize(format), [data, count, format](void* mapped) {
+        packFloats(format, data, mapped, count);
+    });
+}
+
+// Cached memory makes host reads fast, coherent memory is the fallback every device has
+void createReadbackBuffer(VulkanContext* context, VulkanBuffer* buffer, VkDeviceSize size) {
+    // createBuffer() takes 32-bit sizes, larger readbacks would be truncated
+    if (size > UINT32_MAX) {
+        throw std::runtime_error("readback over 4 GiB does not fit into one staging buffer");
+    }
+    VkPhysicalDeviceMemoryProperties deviceMemoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(context->physicalDevice, &deviceMemoryProperties);
+
+    // Buffers with the same usage allow the same memory types, so a probe buffer tells which ones the readback buffer may use
+    VkBufferCreateInfo createInfo = {VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+    createInfo.size = size;
+    createInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    VkBuffer probeBuffer;
+    if (vkCreateBuffer(context->device, &createInfo, 0, &probeBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create readback buffer!");
+    }
+    VkMemoryRequirements memoryRequirements;
+    vkGetBufferMemoryRequirements(context->device, probeBuffer, &memoryRequirements);
+    vkDestroyBuffer(context->device, probeBuffer, 0);
+
+    VkMemoryPropertyFlags cachedProperties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+    VkMemoryPropertyFlags memoryProperties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    for (uint32_t i = 0; i < deviceMemoryProperties.memoryTypeCount; ++i) {
+        if ((memoryRequirements.memoryTypeBits & (1 << i)) &&
+            (deviceMemoryProperties.memoryTypes[i].propertyFlags & cachedProperties) == cachedProperties) {
+            memoryProperties = cachedProperties;
+            break;
+        }
+    }
+
+    createBuffer(context, buffer, static_cast<uint32_t>(size), VK_BUFFER_USAGE_TRANSFER_DST_BIT, memoryProperties);
+}
+
+// Makes device writes visible to the host, which non-coherent (cached) memory needs before every read
+void invalidateMappedBuffer(VulkanContext* context, VulkanBuffer* buffer) {
+    VkMappedMemoryRange range = {VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE};
+    range.memory = buffer->memory;
+    range.offset = 0;
+    range.size = VK_WHOLE_SIZE;
+    vkInvalidateMappedMemoryRanges(context->device, 1, &range);
 }
 
-void getDataFromBufferWithStagingBuffer(VulkanContext* context, VulkanBuffer* buffer, void* data, size_t size) {
+// read gets the size bytes of the mapped staging buffer
+static void readbackRegions(VulkanContext* context, VulkanBuffer* buffer, size_t size, const VkBufferCopy* regions, uint32_t regionCount, const std::function<void(const void*)>& read) {
     VulkanBuffer stagingBuffer;
-    createBuffer(
-        context, 
-        &stagingBuffer, 
-        size, 
-        VK_BUFFER_USAGE_TRANSFER_DST_BIT, 
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-    );
+    createReadbackBuffer(context, &stagingBuffer, size);
+
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands(context);
+    vkCmdCopyBuffer(commandBuffer, buffer->buffer, stagingBuffer.buffer, regionCount, regions);
+    endSingleTimeCommands(context, commandBuffer);
 
     void* mapped;
-    
+    vkMapMemory(context->device, stagingBuffer.memory, 0, VK_WHOLE_SIZE, 0, &mapped);
+    invalidateMappedBuffer(context, &stagingBuffer);
+    read(mapped);
+    vkUnmapMemory(context->device, stagingBuffer.memory);
 
-    copyBuffer(context, buffer, &stagingBuffer, size);
+    destroyBuffer(context, &stagingBuffer);
+}
 
-    vkMapMemory(context->device, stagingBuffer.memory, 0, size, 0, &mapped);
-    memcpy(data, mapped, size);
-    vkUnmapMemory(context->device, stagingBuffer.memory);
+void getDataFromBufferWithStagingBuffer(VulkanContext* context, VulkanBuffer* buffer, void* data, size_t size, VkDeviceSize offset) {
+    VkBufferCopy region = {offset, 0, size};
+    readbackRegions(context, buffer, size, &region, 1, [data, size](const void* mapped) {
+        memcpy(data, mapped, size);
+    });
+}
 
-    vkDestroyBuffer(context->device, stagingBuffer.buffer, 0);
-    vkFreeMemory(context->device, stagingBuffer.memory, 0);
+void getPackedDataFromBuffer(VulkanContext* context, VulkanBuffer* buffer, float* data, size_t count, PackedFormat format, VkDeviceSize offset) {
+    size_t size = count * getPackedElementSize(format);
+    VkBufferCopy region = {offset, 0, size};
+    readbackRegions(context, buffer, size, &region, 1, [data, count, format](const void* mapped) {
+        unpackFloats(format, mapped, data, count);
+    });
+}
+
+// Only the selected elements are transferred, they arrive tightly packed in data
+void getStridedDataFromBufferWithStagingBuffer(VulkanContext* context, VulkanBuffer* buffer, void* data, size_t elementSize, uint32_t elementCount, VkDeviceSize stride, VkDeviceSize offset) {
+    if (elementCount == 0) {
+        return;
+    }
+    if (stride < elementSize) {
+        throw std::runtime_error("readback stride must not be smaller than the element size");
+    }
+    if (stride == elementSize) {
+        getDataFromBufferWithStagingBuffer(context, buffer, data, elementSize * elementCount, offset);
+        return;
+    }
+
+    std::vector<VkBufferCopy> regions(elementCount);
+    for (uint32_t i = 0; i < elementCount; ++i) {
+        regions[i] = {offset + i * stride, i * elementSize, elementSize};
+    }
+    size_t size = elementSize * elementCount;
+    readbackRegions(context, buffer, size, regions.data(), elementCount, [data, size](const void* mapped) {
+        memcpy(data, mapped, size);
+    });
 }
 
 void destroyBuffer(VulkanContext* context, VulkanBuffer* buffer) {
     vkDestroyBuffer(context->device, buffer->buffer, 0);
-    vkFreeMemory(context->device, buffer->memory, 0);
+    freeMemory(context, buffer->memory);
+}
+
+VkDeviceAddress getBufferDeviceAddress(VulkanContext* context, VulkanBuffer* buffer) {
+    VkBufferDeviceAddressInfo addressInfo = {VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO};
+    addressInfo.buffer = buffer->buffer;
+    return vkGetBufferDeviceAddress(context->device, &addressInfo);
 }
@@ -0,0 +1,540 @@
+#include "vulkan/vulkan_core.h"
+#include "vulkan_base.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CPU_SIMD_SSE2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define CPU_SIMD_NEON 1
+#endif
+
+// Smallest range a task gets, below this the queue overhead outweighs the work
+#define CPU_MIN_GRAIN 16384
+#define CPU_RADIX_BITS 8
+#define CPU_RADIX_DIGITS (1 << CPU_RADIX_BITS)
+#define CPU_FILTER_MAX_RADIUS 16
+
+// Pops a task from the given queue or steals one from the others, returns false when every queue is empty
+static bool runQueuedTask(CpuThreadPool* pool, size_t ownQueue) {
+    std::function<void()> task;
+    size_t queueCount = pool->queues.size();
+    for (size_t i = 0; i < queueCount && !task; ++i) {
+        CpuWorkQueue* queue = pool->queues[(ownQueue + i) % queueCount];
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        if (queue->tasks.empty()) {
+            continue;
+        }
+        if (i == 0) {
+            task = std::move(queue->tasks.back());
+            queue->tasks.pop_back();
+        } else {
+            task = std::move(queue->tasks.front());
+            queue->tasks.pop_front();
+        }
+    }
+    if (!task) {
+        return false;
+    }
+    pool->queuedTasks--;
+    task();
+    return true;
+}
+
+static void runWorker(CpuThreadPool* pool, size_t index) {
+    while (true) {
+        if (runQueuedTask(pool, index)) {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(pool->sleepMutex);
+        pool->wakeUp.wait(lock, [pool]() { return pool->stopping || pool->queuedTasks > 0; });
+        if (pool->stopping && pool->queuedTasks <= 0) {
+            return;
+        }
+    }
+}
+
+CpuThreadPool* createCpuThreadPool(uint32_t threadCount) {
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    CpuThreadPool* pool = new CpuThreadPool;
+    pool->queuedTasks = 0;
+    pool->nextQueue = 0;
+    pool->stopping = false;
+    // The calling thread helps, so one thread less is enough
+    uint32_t workerCount = threadCount - 1;
+    for (uint32_t i = 0; i < std::max(workerCount, 1u); ++i) {
+        pool->queues.push_back(new CpuWorkQueue);
+    }
+    for (uint32_t i = 0; i < workerCount; ++i) {
+        pool->workers.push_back(std::thread(runWorker, pool, i));
+    }
+    return pool;
+}
+
+void destroyCpuThreadPool(CpuThreadPool* pool) {
+    {
+        std::lock_guard<std::mutex> lock(pool->sleepMutex);
+        pool->stopping = true;
+    }
+    pool->wakeUp.notify_all();
+    for (std::thread& worker : pool->workers) {
+        worker.join();
+    }
+    for (CpuWorkQueue* queue : pool->queues) {
+        delete queue;
+    }
+    delete pool;
+}
+
+void cpuParallelFor(CpuThreadPool* pool, size_t count, size_t grainSize, const std::function<void(size_t begin, size_t end)>& body) {
+    if (count == 0) {
+        return;
+    }
+    grainSize = std::max<size_t>(grainSize, 1);
+    size_t chunkCount = (count + grainSize - 1) / grainSize;
+    if (chunkCount == 1 || pool->workers.empty()) {
+        for (size_t begin = 0; begin < count; begin += grainSize) {
+            body(begin, std::min(begin + grainSize, count));
+        }
+        return;
+    }
+
+    // Chunks are spread round robin, so every worker starts on its own queue before it steals
+    std::atomic<size_t> remaining(chunkCount);
+    size_t queueCount = pool->queues.size();
+    size_t firstQueue = pool->nextQueue++ % queueCount;
+    for (size_t chunk = 0; chunk < chunkCount; ++chunk) {
+        size_t begin = chunk * grainSize;
+        size_t end = std::min(begin + grainSize, count);
+        CpuWorkQueue* queue = pool->queues[(firstQueue + chunk) % queueCount];
+        pool->queuedTasks++;
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        queue->tasks.push_back([&body, &remaining, begin, end]() {
+            body(begin, end);
+            remaining--;
+        });
+    }
+    {
+        std::lock_guard<std::mutex> lock(pool->sleepMutex);
+    }
+    pool->wakeUp.notify_all();
+
+    // Also runs chunks of other calls, which keeps nested cpuParallelFor calls from deadlocking
+    while (remaining > 0) {
+        if (!runQueuedTask(pool, firstQueue)) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+// Splits count into about four chunks per thread so stealing can even out slow chunks
+static size_t getGrainSize(CpuThreadPool* pool, size_t count) {
+    size_t threadCount = pool->workers.size() + 1;
+    return std::max<size_t>(CPU_MIN_GRAIN, (count + threadCount * 4 - 1) / (threadCount * 4));
+}
+
+void cpuMultiplyAdd(CpuThreadPool* pool, float* data, size_t count, float factor, float offset) {
+    cpuParallelFor(pool, count, getGrainSize(pool, count), [=](size_t begin, size_t end) {
+        size_t i = begin;
+#if CPU_SIMD_SSE2
+        __m128 factors = _mm_set1_ps(factor);
+        __m128 offsets = _mm_set1_ps(offset);
+        for (; i + 4 <= end; i += 4) {
+            _mm_storeu_ps(data + i, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(data + i), factors), offsets));
+        }
+#elif CPU_SIMD_NEON
+        float32x4_t factors = vdupq_n_f32(factor);
+        float32x4_t offsets = vdupq_n_f32(offset);
+        for (; i + 4 <= end; i += 4) {
+            vst1q_f32(data + i, vaddq_f32(vmulq_f32(vld1q_f32(data + i), factors), offsets));
+        }
+#endif
+        for (; i < end; ++i) {
+            data[i] = data[i] * factor + offset;
+        }
+    });
+}
+
+// 1 - c of a unorm8 channel is exactly 255 - c, which is c ^ 0xFF. Pixels are read as little endian rgba words
+void cpuInvertImage(CpuThreadPool* pool, uint8_t* pixels, size_t pixelCount) {
+    const uint32_t colorMask = 0x00FFFFFF;
+    cpuParallelFor(pool, pixelCount, getGrainSize(pool, pixelCount), [=](size_t begin, size_t end) {
+        uint32_t* words = reinterpret_cast<uint32_t*>(pixels);
+        size_t i = begin;
+#if CPU_SIMD_SSE2
+        __m128i masks = _mm_set1_epi32(colorMask);
+        for (; i + 4 <= end; i += 4) {
+            __m128i* address = reinterpret_cast<__m128i*>(words + i);
+            _mm_storeu_si128(address, _mm_xor_si128(_mm_loadu_si128(address), masks));
+        }
+#elif CPU_SIMD_NEON
+        uint32x4_t masks = vdupq_n_u32(colorMask);
+        for (; i + 4 <= end; i += 4) {
+            vst1q_u32(words + i, veorq_u32(vld1q_u32(words + i), masks));
+        }
+#endif
+        for (; i < end; ++i) {
+            words[i] ^= colorMask;
+        }
+    });
+}
+
+// One rgba pixel as four floats, the filters work on whole pixels like the vec4s of the shader
+#if CPU_SIMD_SSE2
+typedef __m128 CpuPixel;
+
+static inline CpuPixel loadPixel(const uint8_t* pixel) {
+    int32_t word;
+    memcpy(&word, pixel, sizeof(word));
+    __m128i zero = _mm_setzero_si128();
+    __m128i channels = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(word), zero), zero);
+    return _mm_div_ps(_mm_cvtepi32_ps(channels), _mm_set1_ps(255.0f));
+}
+
+static inline CpuPixel splatPixel(float value) { return _mm_set1_ps(value); }
+static inline CpuPixel addPixels(CpuPixel a, CpuPixel b) { return _mm_add_ps(a, b); }
+static inline CpuPixel multiplyPixels(CpuPixel a, CpuPixel b) { return _mm_mul_ps(a, b); }
+static inline CpuPixel minPixels(CpuPixel a, CpuPixel b) { return _mm_min_ps(a, b); }
+static inline CpuPixel maxPixels(CpuPixel a, CpuPixel b) { return _mm_max_ps(a, b); }
+static inline void getPixelChannels(CpuPixel pixel, float* channels) { _mm_storeu_ps(channels, pixel); }
+#elif CPU_SIMD_NEON
+typedef float32x4_t CpuPixel;
+
+static inline CpuPixel loadPixel(const uint8_t* pixel) {
+    float channels[4] = {(float)pixel[0], (float)pixel[1], (float)pixel[2], (float)pixel[3]};
+    return vdivq_f32(vld1q_f32(channels), vdupq_n_f32(255.0f));
+}
+
+static inline CpuPixel splatPixel(float value) { return vdupq_n_f32(value); }
+static inline CpuPixel addPixels(CpuPixel a, CpuPixel b) { return vaddq_f32(a, b); }
+static inline CpuPixel multiplyPixels(CpuPixel a, CpuPixel b) { return vmulq_f32(a, b); }
+static inline CpuPixel minPixels(CpuPixel a, CpuPixel b) { return vminq_f32(a, b); }
+static inline CpuPixel maxPixels(CpuPixel a, CpuPixel b) { return vmaxq_f32(a, b); }
+static inline void getPixelChannels(CpuPixel pixel, float* channels) { vst1q_f32(channels, pixel); }
+#else
+struct CpuPixel {
+    float c[4];
+};
+
+static inline CpuPixel loadPixel(const uint8_t* pixel) {
+    CpuPixel result = {{pixel[0] / 255.0f, pixel[1] / 255.0f, pixel[2] / 255.0f, pixel[3] / 255.0f}};
+    return result;
+}
+
+static inline CpuPixel splatPixel(float value) {
+    CpuPixel result = {{value, value, value, value}};
+    return result;
+}
+
+static inline CpuPixel addPixels(CpuPixel a, CpuPixel b) {
+    for (int i = 0; i < 4; ++i) a.c[i] += b.c[i];
+    return a;
+}
+
+static inline CpuPixel multiplyPixels(CpuPixel a, CpuPixel b) {
+    for (int i = 0; i < 4; ++i) a.c[i] *= b.c[i];
+    return a;
+}
+
+static inline CpuPixel minPixels(CpuPixel a, CpuPixel b) {
+    for (int i = 0; i < 4; ++i) a.c[i] = std::min(a.c[i], b.c[i]);
+    return a;
+}
+
+static inline CpuPixel maxPixels(CpuPixel a, CpuPixel b) {
+    for (int i = 0; i < 4; ++i) a.c[i] = std::max(a.c[i], b.c[i]);
+    return a;
+}
+
+static inline void getPixelChannels(CpuPixel pixel, float* channels) { memcpy(channels, pixel.c, sizeof(pixel.c)); }
+#endif
+
+// Same conversion as a store to an rgba8 storage image
+static inline uint8_t toUnorm8(float value) {
+    value = std::min(std::max(value, 0.0f), 1.0f);
+    return static_cast<uint8_t>(value * 255.0f + 0.5f);
+}
+
+// One pass of filter_separable.comp from source into destination, alpha stays the one of the center pixel
+static void filterPass(CpuThreadPool* pool, const uint8_t* source, uint8_t* destination, uint32_t width, uint32_t height, ImageFilter filter, int radius, const float* weights, float weightSum, bool vertical) {
+    cpuParallelFor(pool, height, 1, [=](size_t rowBegin, size_t rowEnd) {
+        for (size_t y = rowBegin; y < rowEnd; ++y) {
+            for (uint32_t x = 0; x < width; ++x) {
+                const uint8_t* center = source + (y * width + x) * 4;
+                CpuPixel result = loadPixel(center);
+                CpuPixel sum = splatPixel(0.0f);
+                for (int k = -radius; k <= radius; ++k) {
+                    int64_t sampleX = vertical ? x : std::min(std::max<int64_t>((int64_t)x + k, 0), (int64_t)width - 1);
+                    int64_t sampleY = vertical ? std::min(std::max<int64_t>((int64_t)y + k, 0), (int64_t)height - 1) : y;
+                    CpuPixel neighbour = loadPixel(source + (sampleY * width + sampleX) * 4);
+                    if (filter == ImageFilter::ERODE) {
+                        result = minPixels(result, neighbour);
+                    } else if (filter == ImageFilter::DILATE) {
+                        result = maxPixels(result, neighbour);
+                    } else {
+                        sum = addPixels(sum, multiplyPixels(splatPixel(weights[k + radius]), neighbour));
+                    }
+                }
+                if (filter == ImageFilter::GAUSSIAN_BLUR || filter == ImageFilter::BOX_BLUR) {
+                    result = multiplyPixels(sum, splatPixel(1.0f / weightSum));
+                }
+
+                float channels[4];
+                getPixelChannels(result, channels);
+                uint8_t* output = destination + (y * width + x) * 4;
+                output[0] = toUnorm8(channels[0]);
+                output[1] = toUnorm8(channels[1]);
+                output[2] = toUnorm8(channels[2]);
+                output[3] = center[3];
+            }
+        }
+    });
+}
+
+void cpuSeparableFilter(CpuThreadPool* pool, uint8_t* pixels, uint32_t width, uint32_t height, ImageFilter filter, uint32_t radius, float sigma) {
+    if (radius == 0 || radius > CPU_FILTER_MAX_RADIUS) {
+        throw std::runtime_error("filter radius must be between 1 and 16");
+    }
+
+    float weights[2 * CPU_FILTER_MAX_RADIUS + 1];
+    float weightSum = 0.0f;
+    if (sigma <= 0.0f) {
+        sigma = std::max(radius / 2.0f, 0.5f);
+    }
+    for (int k = -(int)radius; k <= (int)radius; ++k) {
+        weights[k + radius] = filter == ImageFilter::BOX_BLUR ? 1.0f : std::exp(-float(k * k) / (2.0f * sigma * sigma));
+        weightSum += weights[k + radius];
+    }
+
+    std::vector<uint8_t> intermediate(size_t(width) * height * 4);
+    filterPass(pool, pixels, intermediate.data(), width, height, filter, radius, weights, weightSum, false);
+    filterPass(pool, intermediate.data(), pixels, width, height, filter, radius, weights, weightSum, true);
+}
+
+float cpuReduceSum(CpuThreadPool* pool, const float* input, size_t count) {
+    size_t grainSize = getGrainSize(pool, count);
+    std::vector<float> partials((count + grainSize - 1) / grainSize, 0.0f);
+    cpuParallelFor(pool, count, grainSize, [&](size_t begin, size_t end) {
+        size_t i = begin;
+        float sum = 0.0f;
+#if CPU_SIMD_SSE2
+        __m128 sums = _mm_setzero_ps();
+        for (; i + 4 <= end; i += 4) {
+            sums = _mm_add_ps(sums, _mm_loadu_ps(input + i));
+        }
+        float lanes[4];
+        _mm_storeu_ps(lanes, sums);
+        sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#elif CPU_SIMD_NEON
+        float32x4_t sums = vdupq_n_f32(0.0f);
+        for (; i + 4 <= end; i += 4) {
+            sums = vaddq_f32(sums, vld1q_f32(input + i));
+        }
+        float lanes[4];
+        vst1q_f32(lanes, sums);
+        sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif
+        for (; i < end; ++i) {
+            sum += input[i];
+        }
+        partials[begin / grainSize] = sum;
+    });
+
+    float sum = 0.0f;
+    for (float partial : partials) {
+        sum += partial;
+    }
+    return sum;
+}
+
+// Sums of every chunk, scanned into the offset each chunk starts from
+static std::vector<uint32_t> scanChunkSums(std::vector<uint32_t>& chunkSums) {
+    std::vector<uint32_t> offsets(chunkSums.size());
+    uint32_t sum = 0;
+    for (size_t i = 0; i < chunkSums.size(); ++i) {
+        offsets[i] = sum;
+        sum += chunkSums[i];
+    }
+    return offsets;
+}
+
+void cpuPrefixSum(CpuThreadPool* pool, const uint32_t* input, uint32_t* output, size_t count, bool inclusive) {
+    size_t grainSize = getGrainSize(pool, count);
+    std::vector<uint32_t> chunkSums((count + grainSize - 1) / grainSize, 0);
+    cpuParallelFor(pool, count, grainSize, [&](size_t begin, size_t end) {
+        uint32_t sum = 0;
+        for (size_t i = begin; i < end; ++i) {
+            sum += input[i];
+        }
+        chunkSums[begin / grainSize] = sum;
+    });
+    std::vector<uint32_t> offsets = scanChunkSums(chunkSums);
+
+    // Works in place as well, every element is read before it is written
+    cpuParallelFor(pool, count, grainSize, [&](size_t begin, size_t end) {
+        uint32_t sum = offsets[begin / grainSize];
+        for (size_t i = begin; i < end; ++i) {
+            uint32_t value = input[i];
+            output[i] = inclusive ? sum + value : sum;
+            sum += value;
+        }
+    });
+}
+
+void cpuHistogram(CpuThreadPool* pool, const uint32_t* input, uint32_t* histogram, size_t count, uint32_t binCount, uint32_t shift) {
+    if (binCount == 0) {
+        throw std::runtime_error("histogram needs at least one bin");
+    }
+    size_t grainSize = getGrainSize(pool, count);
+    size_t chunkCount = (count + grainSize - 1) / grainSize;
+    std::vector<uint32_t> chunkBins(chunkCount * binCount, 0);
+    cpuParallelFor(pool, count, grainSize, [&](size_t begin, size_t end) {
+        uint32_t* bins = &chunkBins[(begin / grainSize) * binCount];
+        for (size_t i = begin; i < end; ++i) {
+            uint32_t value = shift < 32 ? input[i] >> shift : 0;
+            bins[std::min(value, binCount - 1)]++;
+        }
+    });
+
+    for (uint32_t bin = 0; bin < binCount; ++bin) {
+        uint32_t sum = 0;
+        for (size_t chunk = 0; chunk < chunkCount; ++chunk) {
+            sum += chunkBins[chunk * binCount + bin];
+        }
+        histogram[bin] = sum;
+    }
+}
+
+uint32_t cpuCompact(CpuThreadPool* pool, const uint32_t* input, const uint32_t* flags, uint32_t* output, size_t count) {
+    size_t grainSize = getGrainSize(pool, count);
+    std::vector<uint32_t> chunkCounts((count + grainSize - 1) / grainSize, 0);
+    cpuParallelFor(pool, count, grainSize, [&](size_t begin, size_t end) {
+        uint32_t kept = 0;
+        for (size_t i = begin; i < end; ++i) {
+            kept += flags[i] != 0 ? 1 : 0;
+        }
+        chunkCounts[begin / grainSize] = kept;
+    });
+    std::vector<uint32_t> offsets = scanChunkSums(chunkCounts);
+
+    cpuParallelFor(pool, count, grainSize, [&](size_t begin, size_t end) {
+        uint32_t* destination = output + offsets[begin / grainSize];
+        for (size_t i = begin; i < end; ++i) {
+            if (flags[i] != 0) {
+                *destination++ = input[i];
+            }
+        }
+    });
+    return chunkCounts.empty() ? 0 : offsets.back() + chunkCounts.back();
+}
+
+// Stable LSD radix sort with one histogram per chunk and digit, so it orders equal keys like the GPU sort
+void cpuRadixSortPairs(CpuThreadPool* pool, uint32_t* keys, uint32_t* values, size_t count) {
+    size_t grainSize = getGrainSize(pool, count);
+    size_t chunkCount = (count + grainSize - 1) / grainSize;
+    std::vector<uint32_t> keyScratch(count);
+    std::vector<uint32_t> valueScratch(count);
+    std::vector<uint32_t> chunkOffsets(chunkCount * CPU_RADIX_DIGITS);
+
+    uint32_t* sourceKeys = keys;
+    uint32_t* sourceValues = values;
+    uint32_t* destinationKeys = keyScratch.data();
+    uint32_t* destinationValues = valueScratch.data();
+    for (uint32_t shift = 0; shift < 32; shift += CPU_RADIX_BITS) {
+        std::fill(chunkOffsets.begin(), chunkOffsets.end(), 0);
+        cpuParallelFor(pool, count, grainSize, [&](size_t begin, size_t end) {
+            uint32_t* counts = &chunkOffsets[(begin / grainSize) * CPU_RADIX_DIGITS];
+            for (size_t i = begin; i < end; ++i) {
+                counts[(sourceKeys[i] >> shift) & (CPU_RADIX_DIGITS - 1)]++;
+            }
+        });
+
+        // Digit major, then chunk order, so every chunk scatters behind the chunks before it
+        uint32_t sum = 0;
+        for (uint32_t digit = 0; digit < CPU_RADIX_DIGITS; ++digit) {
+            for (size_t chunk = 0; chunk < chunkCount; ++chunk) {
+                uint32_t digitCount = chunkOffsets[chunk * CPU_RADIX_DIGITS + digit];
+                chunkOffsets[chunk * CPU_RADIX_DIGITS + digit] = sum;
+                sum += digitCount;
+            }
+        }
+
+        cpuParallelFor(pool, count, grainSize, [&](size_t begin, size_t end) {
+            uint32_t* offsets = &chunkOffsets[(begin / grainSize) * CPU_RADIX_DIGITS];
+            for (size_t i = begin; i < end; ++i) {
+                uint32_t slot = offsets[(sourceKeys[i] >> shift) & (CPU_RADIX_DIGITS - 1)]++;
+                destinationKeys[slot] = sourceKeys[i];
+                destinationValues[slot] = sourceValues[i];
+            }
+        });
+        std::swap(sourceKeys, destinationKeys);
+        std::swap(sourceValues, destinationValues);
+    }
+    // An even number of passes ends in the caller's arrays again
+}
+
+template <typename T, typename Difference>
+static void compareResults(CpuComparison* comparison, const T* gpu, const T* cpu, size_t count, Difference difference) {
+    comparison->elementCount = count;
+    comparison->mismatches = 0;
+    comparison->firstMismatch = count;
+    comparison->maxError = 0.0;
+    for (size_t i = 0; i < count; ++i) {
+        bool mismatch;
+        double error = difference(gpu[i], cpu[i], &mismatch);
+        comparison->maxError = std::max(comparison->maxError, error);
+        if (mismatch) {
+            if (comparison->mismatches == 0) {
+                comparison->firstMismatch = i;
+            }
+            comparison->mismatches++;
+        }
+    }
+}
+
+void compareFloatResults(CpuComparison* comparison, const float* gpu, const float* cpu, size_t count, float tolerance) {
+    compareResults(comparison, gpu, cpu, count, [tolerance](float a, float b, bool* mismatch) {
+        double error = std::fabs((double)a - (double)b);
+        // NaN never compares as close
+        *mismatch = !(error <= tolerance * std::max(1.0, std::fabs((double)b)));
+        return error;
+    });
+}
+
+void compareUintResults(CpuComparison* comparison, const uint32_t* gpu, const uint32_t* cpu, size_t count) {
+    compareResults(comparison, gpu, cpu, count, [](uint32_t a, uint32_t b, bool* mismatch) {
+        *mismatch = a != b;
+        return a > b ? (double)(a - b) : (double)(b - a);
+    });
+}
+
+void compareByteResults(CpuComparison* comparison, const uint8_t* gpu, const uint8_t* cpu, size_t count, uint8_t tolerance) {
+    compareResults(comparison, gpu, cpu, count, [tolerance](uint8_t a, uint8_t b, bool* mismatch) {
+        int error = a > b ? a - b : b - a;
+        *mismatch = error > tolerance;
+        return (double)error;
+    });
+}
+
+void printCpuComparison(const CpuComparison* comparison) {
+    char speedup[32] = "";
+    if (comparison->gpuMs > 0.0 && comparison->cpuMs > 0.0) {
+        snprintf(speedup, sizeof(speedup), ", %.2fx speedup", comparison->cpuMs / comparison->gpuMs);
+    }
+    printf("%-12s gpu %9.3f ms, cpu %9.3f ms%s\n", comparison->name, comparison->gpuMs, comparison->cpuMs, speedup);
+    if (comparison->mismatches > 0) {
+        LOG_ERROR(comparison->name << ": " << comparison->mismatches << " of " << comparison->elementCount
+            << " elements differ from the CPU reference, the first at " << comparison->firstMismatch
+            << ", max error " << comparison->maxError);
+    } else {
+        LOG(comparison->name << ": all " << comparison->elementCount << " elements match the CPU reference, max error " << comparison->maxError);
+    }
+}
@@ -0,0 +1,217 @@
+#include "vulkan/vulkan_core.h"
+#include "vulkan_base.h"
+#include <stdexcept>
+
+// How long waitForSubmission blocks on one fence before it polls again, recycled fences may belong to a later submission
+#define FENCE_POLL_TIMEOUT_NS 1000000
+
+void initSubmissionTracker(VulkanContext* context) {
+    VulkanSubmissionTracker* submissions = &context->submissions;
+    submissions->timeline = VK_NULL_HANDLE;
+    submissions->submittedValue = 0;
+    submissions->completedValue = 0;
+    if (!context->timelineSemaphoreSupported) {
+        return;
+    }
+
+    VkSemaphoreTypeCreateInfo typeInfo = {VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO};
+    typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    typeInfo.initialValue = 0;
+    VkSemaphoreCreateInfo createInfo = {VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
+    createInfo.pNext = &typeInfo;
+    if (vkCreateSemaphore(context->device, &createInfo, 0, &submissions->timeline) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create submission timeline semaphore!");
+    }
+}
+
+void destroySubmissionTracker(VulkanContext* context) {
+    VulkanSubmissionTracker* submissions = &context->submissions;
+    for (auto& pending : submissions->pendingFences) {
+        vkDestroyFence(context->device, pending.second, 0);
+    }
+    for (VkFence fence : submissions->freeFences) {
+        vkDestroyFence(context->device, fence, 0);
+    }
+    for (VkFence fence : submissions->retiredFences) {
+        vkDestroyFence(context->device, fence, 0);
+    }
+    submissions->pendingFences.clear();
+    submissions->freeFences.clear();
+    submissions->retiredFences.clear();
+    submissions->fenceWaiters.clear();
+    if (submissions->timeline != VK_NULL_HANDLE) {
+        vkDestroySemaphore(context->device, submissions->timeline, 0);
+    }
+}
+
+static void recycleFence(VulkanContext* context, VkFence fence) {
+    vkResetFences(context->device, 1, &fence);
+    context->submissions.freeFences.push_back(fence);
+}
+
+// Fences of finished submissions go back to the free list, the caller holds queueMutex.
+// A fence another thread still waits on must not be reset, so it is retired until that wait returns
+static void pollSubmissionFences(VulkanContext* context) {
+    VulkanSubmissionTracker* submissions = &context->submissions;
+    while (!submissions->pendingFences.empty()) {
+        VkFence fence = submissions->pendingFences.front().second;
+        if (vkGetFenceStatus(context->device, fence) != VK_SUCCESS) {
+            break;
+        }
+        if (submissions->fenceWaiters.count(fence) > 0) {
+            submissions->retiredFences.push_back(fence);
+        } else {
+            recycleFence(context, fence);
+        }
+        submissions->completedValue = submissions->pendingFences.front().first;
+        submissions->pendingFences.pop_front();
+    }
+    if (submissions->pendingFences.empty()) {
+        submissions->completedValue = submissions->submittedValue;
+    }
+}
+
+uint64_t getCompletedSubmission(VulkanContext* context) {
+    VulkanSubmissionTracker* submissions = &context->submissions;
+    if (submissions->timeline != VK_NULL_HANDLE) {
+        uint64_t value;
+        if (vkGetSemaphoreCounterValue(context->device, submissions->timeline, &value) != VK_SUCCESS) {
+            throw std::runtime_error("failed to read submission timeline semaphore!");
+        }
+        return value;
+    }
+
+    std::lock_guard<std::mutex> lock(context->queueMutex);
+    pollSubmissionFences(context);
+    return submissions->completedValue;
+}
+
+void waitForSubmission(VulkanContext* context, uint64_t submission) {
+    VulkanSubmissionTracker* submissions = &context->submissions;
+    if (submissions->timeline != VK_NULL_HANDLE) {
+        VkSemaphoreWaitInfo waitInfo = {VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO};
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &submissions->timeline;
+        waitInfo.pValues = &submission;
+        if (vkWaitSemaphores(context->device, &waitInfo, UINT64_MAX) != VK_SUCCESS) {
+            throw std::runtime_error("failed to wait for submission timeline semaphore!");
+        }
+        return;
+    }
+
+    // The queue lock is only held while polling, so other threads keep submitting while this one waits
+    while (true) {
+        VkFence fence;
+        {
+            std::lock_guard<std::mutex> lock(context->queueMutex);
+            pollSubmissionFences(context);
+            if (submissions->completedValue >= submission) {
+                return;
+            }
+            fence = submissions->pendingFences.front().second;
+            submissions->fenceWaiters[fence]++;
+        }
+        VkResult result = vkWaitForFences(context->device, 1, &fence, VK_TRUE, FENCE_POLL_TIMEOUT_NS);
+        {
+            std::lock_guard<std::mutex> lock(context->queueMutex);
+            auto waiters = submissions->fenceWaiters.find(fence);
+            if (--waiters->second == 0) {
+                submissions->fenceWaiters.erase(waiters);
+                for (size_t i = 0; i < submissions->retiredFences.size(); ++i) {
+                    if (submissions->retiredFences[i] == fence) {
+                        submissions->retiredFences.erase(submissions->retiredFences.begin() + i);
+                        recycleFence(context, fence);
+                        break;
+                    }
+                }
+            }
+        }
+        if (result != VK_SUCCESS && result != VK_TIMEOUT) {
+            throw std::runtime_error("failed to wait for submission fence!");
+        }
+    }
+}
+
+void deferDestruction(VulkanContext* context, std::function<void()> destroy) {
+    uint64_t submission;
+    {
+        std::lock_guard<std::mutex> lock(context->queueMutex);
+        submission = context->submissions.submittedValue;
+    }
+    std::lock_guard<std::mutex> lock(context->submissions.deletionMutex);
+    context->submissions.deletionQueue.push_back({submission, std::move(destroy)});
+}
+
+// Entries are queued in submission order (up to threads racing between the two locks of deferDestruction),
+// so collecting stops at the first entry that is not ready yet
+void collectDeferredDestructions(VulkanContext* context) {
+    VulkanSubmissionTracker* submissions = &context->submissions;
+    {
+        std::lock_guard<std::mutex> lock(submissions->deletionMutex);
+        if (submissions->deletionQueue.empty()) {
+            return;
+        }
+    }
+
+    uint64_t completed = getCompletedSubmission(context);
+    std::vector<std::function<void()>> ready;
+    {
+        std::lock_guard<std::mutex> lock(submissions->deletionMutex);
+        while (!submissions->deletionQueue.empty() && submissions->deletionQueue.front().submission <= completed) {
+            ready.push_back(std::move(submissions->deletionQueue.front().destroy));
+            submissions->deletionQueue.pop_front();
+        }
+    }
+    // Destroy functions may queue new entries themselves
+    for (auto& destroy : ready) {
+        destroy();
+    }
+}
+
+// Destroy functions may queue further entries, e.g. a pipeline whose teardown defers its buffers, so this repeats until
+// the queue stays empty
+void flushDeferredDestructions(VulkanContext* context) {
+    VulkanSubmissionTracker* submissions = &context->submissions;
+    while (true) {
+        uint64_t submitted;
+        {
+            std::lock_guard<std::mutex> lock(context->queueMutex);
+            submitted = submissions->submittedValue;
+        }
+        waitForSubmission(context, submitted);
+        collectDeferredDestructions(context);
+
+        std::lock_guard<std::mutex> lock(submissions->deletionMutex);
+        if (submissions->deletionQueue.empty()) {
+            return;
+        }
+    }
+}
+
+void deferDestroyBuffer(VulkanContext* context, VulkanBuffer* buffer) {
+    VulkanBuffer retired = *buffer;
+    deferDestruction(context, [context, retired]() mutable {
+        destroyBuffer(context, &retired);
+    });
+}
+
+void deferDestroyImage(VulkanContext* context, VulkanImage* image) {
+    VulkanImage retired = *image;
+    deferDestruction(context, [context, retired]() mutable {
+        destroyImage(context, &retired);
+    });
+}
+
+void deferDestroyPipeline(VulkanContext* context, VulkanPipeline* pipeline) {
+    VulkanPipeline retired = *pipeline;
+    deferDestruction(context, [context, retired]() mutable {
+        destroyPipeline(context, &retired);
+    });
+}
+
+void deferDestroyDescriptorSet(VulkanContext* context, VulkanDescriptorSet* descriptorSet) {
+    deferDestruction(context, [context, descriptorSet]() {
+        destroyDescriptorSet(context, descriptorSet);
+        delete descriptorSet;
+    });
+}
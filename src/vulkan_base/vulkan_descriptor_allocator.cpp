@@ -0,0 +1,134 @@
+#include "vulkan/vulkan_core.h"
+#include "vulkan_base.h"
+#include <cstddef>
+#include <stdexcept>
+
+static void createAllocatorPool(VulkanContext* context, VulkanDescriptorAllocator* allocator, uint32_t setCount) {
+    std::vector<VkDescriptorPoolSize> poolSizes = allocator->setPoolSizes;
+    for (size_t i = 0; i < poolSizes.size(); ++i) {
+        poolSizes[i].descriptorCount *= setCount;
+    }
+
+    VkDescriptorPoolCreateInfo createInfo = {VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
+    createInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    createInfo.pPoolSizes = poolSizes.data();
+    createInfo.maxSets = setCount;
+
+    VkDescriptorPool pool;
+    if (vkCreateDescriptorPool(context->device, &createInfo, 0, &pool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create descriptor allocator pool!");
+    }
+    allocator->pools.push_back(pool);
+    allocator->setsPerPool = setCount;
+    allocator->setsLeftInPool = setCount;
+}
+
+VulkanDescriptorAllocator* createDescriptorAllocator(VulkanContext* context, VulkanDescriptorSet* descriptorSet, uint32_t initialSetsPerPool) {
+    if (descriptorSet->descriptorSetLayout == VK_NULL_HANDLE) {
+        throw std::runtime_error("descriptor allocator needs a created descriptor set layout");
+    }
+
+    VulkanDescriptorAllocator* allocator = new VulkanDescriptorAllocator;
+    allocator->descriptorSetLayout = descriptorSet->descriptorSetLayout;
+    allocator->bindingCount = descriptorSet->layoutCount;
+    for (auto typeCount : descriptorSet->descriptorTypeCount) {
+        allocator->setPoolSizes.push_back({typeCount.first, typeCount.second});
+    }
+
+    // Binding i is read from element i of a VulkanDescriptorBufferInfo array, so a job is written with one call
+    std::vector<VkDescriptorUpdateTemplateEntry> entries(descriptorSet->layoutCount);
+    for (uint32_t i = 0; i < descriptorSet->layoutCount; ++i) {
+        VkDescriptorType descriptorType = descriptorSet->descriptorSetLayoutBindings[i].descriptorType;
+        bool isBuffer = descriptorType == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER || descriptorType == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+
+        entries[i].dstBinding = descriptorSet->descriptorSetLayoutBindings[i].binding;
+        entries[i].dstArrayElement = 0;
+        entries[i].descriptorCount = 1;
+        entries[i].descriptorType = descriptorType;
+        entries[i].offset = i * sizeof(VulkanDescriptorBufferInfo) +
+            (isBuffer ? offsetof(VulkanDescriptorBufferInfo, bufferInfo) : offsetof(VulkanDescriptorBufferInfo, imageInfo));
+        entries[i].stride = sizeof(VulkanDescriptorBufferInfo);
+    }
+
+    VkDescriptorUpdateTemplateCreateInfo templateInfo = {VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO};
+    templateInfo.descriptorUpdateEntryCount = static_cast<uint32_t>(entries.size());
+    templateInfo.pDescriptorUpdateEntries = entries.data();
+    templateInfo.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+    templateInfo.descriptorSetLayout = allocator->descriptorSetLayout;
+    if (vkCreateDescriptorUpdateTemplate(context->device, &templateInfo, 0, &allocator->updateTemplate) != VK_SUCCESS) {
+        delete allocator;
+        throw std::runtime_error("failed to create descriptor update template!");
+    }
+
+    createAllocatorPool(context, allocator, initialSetsPerPool > 0 ? initialSetsPerPool : 1);
+    return allocator;
+}
+
+VkDescriptorSet allocateJobDescriptorSet(VulkanContext* context, VulkanDescriptorAllocator* allocator) {
+    std::lock_guard<std::mutex> lock(allocator->mutex);
+    if (!allocator->freeSets.empty()) {
+        VkDescriptorSet descriptorSet = allocator->freeSets.back();
+        allocator->freeSets.pop_back();
+        return descriptorSet;
+    }
+
+    // Every pool is sized for setsPerPool whole sets, so running out of sets is the only way to run out of descriptors
+    if (allocator->setsLeftInPool == 0) {
+        createAllocatorPool(context, allocator, allocator->setsPerPool * 2);
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo = {VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
+    allocInfo.descriptorPool = allocator->pools.back();
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &allocator->descriptorSetLayout;
+
+    VkDescriptorSet descriptorSet;
+    if (vkAllocateDescriptorSets(context->device, &allocInfo, &descriptorSet) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate job descriptorset!");
+    }
+    allocator->setsLeftInPool--;
+    return descriptorSet;
+}
+
+void updateJobDescriptorSet(VulkanContext* context, VulkanDescriptorAllocator* allocator, VkDescriptorSet descriptorSet, const VulkanDescriptorBufferInfo* resources) {
+    vkUpdateDescriptorSetWithTemplate(context->device, descriptorSet, allocator->updateTemplate, resources);
+}
+
+void releaseJobDescriptorSet(VulkanDescriptorAllocator* allocator, VkDescriptorSet descriptorSet) {
+    std::lock_guard<std::mutex> lock(allocator->mutex);
+    allocator->freeSets.push_back(descriptorSet);
+}
+
+// Keeps only the largest pool, so after a few frames every set of a frame comes from one pool
+void resetDescriptorAllocator(VulkanContext* context, VulkanDescriptorAllocator* allocator) {
+    std::lock_guard<std::mutex> lock(allocator->mutex);
+    for (size_t i = 0; i + 1 < allocator->pools.size(); ++i) {
+        vkDestroyDescriptorPool(context->device, allocator->pools[i], 0);
+    }
+    allocator->pools.erase(allocator->pools.begin(), allocator->pools.end() - 1);
+    vkResetDescriptorPool(context->device, allocator->pools.back(), 0);
+    allocator->setsLeftInPool = allocator->setsPerPool;
+    allocator->freeSets.clear();
+}
+
+void destroyDescriptorAllocator(VulkanContext* context, VulkanDescriptorAllocator* allocator) {
+    for (auto pool : allocator->pools) {
+        vkDestroyDescriptorPool(context->device, pool, 0);
+    }
+    vkDestroyDescriptorUpdateTemplate(context->device, allocator->updateTemplate, 0);
+    delete allocator;
+}
+
+VulkanDescriptorBufferInfo describeBuffer(VulkanBuffer* buffer, VkDeviceSize offset, VkDeviceSize range) {
+    VulkanDescriptorBufferInfo info{};
+    info.bufferInfo = {buffer->buffer, offset, range};
+    info.type = VulkanDescriptorBufferInfo::Type::BUFFER;
+    return info;
+}
+
+VulkanDescriptorBufferInfo describeImage(VulkanImage* image, VkSampler sampler) {
+    VulkanDescriptorBufferInfo info{};
+    info.imageInfo = {sampler, image->view, getShaderImageLayout(image)};
+    info.type = VulkanDescriptorBufferInfo::Type::IMAGE;
+    return info;
+}
@@ -8,6 +8,8 @@ VulkanDescriptorSet* initDescriptorSet() {
     VulkanDescriptorSet* descriptorSet = new VulkanDescriptorSet;
     descriptorSet->layoutCount = 0;
     descriptorSet->descriptorSetLayoutBindings = {};
+    descriptorSet->descriptorSetLayout = VK_NULL_HANDLE;
+    descriptorSet->descriptorPool = VK_NULL_HANDLE;
     return descriptorSet;
 }
 
@@ -23,15 +25,17 @@ void addDescriptorSetLayout(VulkanDescriptorSet* descriptorSet, VkDescriptorType
     descriptorSet->descriptorSetLayoutBindings.push_back(layoutBinding);
 }
 
-void createDescriptorSet(VulkanContext* context, VulkanDescriptorSet* descriptorSet) {
-    {
-        VkDescriptorSetLayoutCreateInfo createInfo{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
-        createInfo.bindingCount = descriptorSet->layoutCount;
-        createInfo.pBindings = descriptorSet->descriptorSetLayoutBindings.data();
-        if (vkCreateDescriptorSetLayout(context->device, &createInfo, 0, &descriptorSet->descriptorSetLayout) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create compute descriptor set layout!");
-        }
+void createDescriptorSetLayout(VulkanContext* context, VulkanDescriptorSet* descriptorSet) {
+    VkDescriptorSetLayoutCreateInfo createInfo{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
+    createInfo.bindingCount = descriptorSet->layoutCount;
+    createInfo.pBindings = descriptorSet->descriptorSetLayoutBindings.data();
+    if (vkCreateDescriptorSetLayout(context->device, &createInfo, 0, &descriptorSet->descriptorSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create compute descriptor set layout!");
     }
+}
+
+void createDescriptorSet(VulkanContext* context, VulkanDescriptorSet* descriptorSet) {
+    createDescriptorSetLayout(context, descriptorSet);
 
     std::vector<VkDescriptorPoolSize> poolSizes;
     for(auto typeCount : descriptorSet->descriptorTypeCount){
@@ -82,7 +86,17 @@ void fillDescriptorSet(VulkanContext *context, VulkanDescriptorSet *descriptorSe
                 }
                 writes[i].pBufferInfo = &descriptorSet->buffers[i].bufferInfo;
                 break;
+            case VK_DESCRIPTOR_TYPE_SAMPLER:
+                if (descriptorSet->buffers[i].type != VulkanDescriptorBufferInfo::Type::SAMPLER) {
+                    throw std::runtime_error("Invalid descriptor type while filling descriptorset with data");
+                }
+                writes[i].pImageInfo = &descriptorSet->buffers[i].imageInfo;
+                break;
             case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+                if (descriptorSet->buffers[i].imageInfo.sampler == VK_NULL_HANDLE) {
+                    throw std::runtime_error("Combined image sampler binding requires an image with a sampler");
+                }
+                // fall through
             case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
             case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
                 if (descriptorSet->buffers[i].type != VulkanDescriptorBufferInfo::Type::IMAGE) {
@@ -139,7 +153,7 @@ void VulkanDescriptorSet::addImageAndData(
     createImage(
         context,
         image, size,
-        width, height, depth,
+        width, height, depth, 1,
         format,
         usage,
         memoryProperties
@@ -147,6 +161,10 @@ void VulkanDescriptorSet::addImageAndData(
 
     if (data != NULL) {
         uploadDataToImageWithStagingBuffer(context, image, data);
+    } else {
+        VkCommandBuffer commandBuffer = beginSingleTimeCommands(context);
+        transitionLayout(context, image, getShaderImageLayout(image), commandBuffer);
+        endSingleTimeCommands(context, commandBuffer);
     }
 
     VkDescriptorImageInfo imageInfo = {};
@@ -159,3 +177,50 @@ void VulkanDescriptorSet::addImageAndData(
 
     this->buffers.push_back(info);
 }
+
+void VulkanDescriptorSet::addSampledImageAndData(
+    VulkanContext* context,
+    VulkanImage* image, VkSampler sampler, void* data, size_t size,
+    uint32_t width, uint32_t height, uint32_t depth, uint32_t mipLevels,
+    VkFormat format,
+    VkMemoryPropertyFlags memoryProperties
+) {
+    createImage(
+        context,
+        image, size,
+        width, height, depth, mipLevels,
+        format,
+        VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+        memoryProperties
+    );
+
+    if (data != NULL) {
+        uploadDataToImageWithStagingBuffer(context, image, data);
+    } else {
+        VkCommandBuffer commandBuffer = beginSingleTimeCommands(context);
+        transitionLayout(context, image, getShaderImageLayout(image), commandBuffer);
+        endSingleTimeCommands(context, commandBuffer);
+    }
+
+    VkDescriptorImageInfo imageInfo = {};
+    imageInfo.sampler = sampler;
+    imageInfo.imageLayout = image->currentLayout;
+    imageInfo.imageView = image->view;
+
+    VulkanDescriptorBufferInfo info{};
+    info.imageInfo = imageInfo;
+    info.type = VulkanDescriptorBufferInfo::Type::IMAGE;
+
+    this->buffers.push_back(info);
+}
+
+void VulkanDescriptorSet::addSampler(VkSampler sampler) {
+    VkDescriptorImageInfo imageInfo = {};
+    imageInfo.sampler = sampler;
+
+    VulkanDescriptorBufferInfo info{};
+    info.imageInfo = imageInfo;
+    info.type = VulkanDescriptorBufferInfo::Type::SAMPLER;
+
+    this->buffers.push_back(info);
+}
@@ -1,6 +1,8 @@
 #include "vulkan/vulkan_core.h"
 #include "vulkan_base.h"
+#include <cstring>
 #include <iostream>
+#include <stdexcept>
 
 #define DEBUGGING true
 
@@ -78,6 +80,12 @@ bool selectPhysicalDevice(VulkanContext* context) {
     vkGetPhysicalDeviceProperties(context->physicalDevice, &context->physicalDeviceProperties);
     std::cout << "Selected GPU: " << context->physicalDeviceProperties.deviceName << std::endl;
 
+    context->subgroupProperties = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES};
+    VkPhysicalDeviceProperties2 properties2 = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2};
+    properties2.pNext = &context->subgroupProperties;
+    vkGetPhysicalDeviceProperties2(context->physicalDevice, &properties2);
+    std::cout << "Subgroup size: " << context->subgroupProperties.subgroupSize << std::endl;
+
     delete[] physicalDevices;
     return true;
 }
@@ -107,11 +115,136 @@ bool createLogicalDevice(VulkanContext* context, uint32_t deviceExtensionCount,
     
     VkPhysicalDeviceFeatures enabledFeatures = {};
 
+    // Bindless resources need descriptor indexing and buffer device addresses, which are core since Vulkan 1.2
+    VkPhysicalDeviceDescriptorIndexingFeatures descriptorIndexingFeatures = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES};
+    VkPhysicalDeviceBufferDeviceAddressFeatures bufferDeviceAddressFeatures = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES};
+    // Submissions signal a timeline semaphore for the deletion queue, without it every submission gets a fence
+    VkPhysicalDeviceTimelineSemaphoreFeatures timelineSemaphoreFeatures = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES};
+    // Reduced precision buffers, shaders that declare 16-bit or 8-bit members need these
+    VkPhysicalDevice16BitStorageFeatures storage16BitFeatures = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_16BIT_STORAGE_FEATURES};
+    VkPhysicalDevice8BitStorageFeatures storage8BitFeatures = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_8BIT_STORAGE_FEATURES};
+    VkPhysicalDeviceShaderFloat16Int8Features float16Int8Features = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_FLOAT16_INT8_FEATURES};
+    void* enabledFeatureChain = nullptr;
+    context->bindlessSupported = false;
+    context->bindlessUpdateUnusedWhilePending = false;
+    context->bufferDeviceAddressSupported = false;
+    context->timelineSemaphoreSupported = false;
+    context->storage16BitSupported = false;
+    context->storage8BitSupported = false;
+    context->shaderFloat16Supported = false;
+    context->shaderInt8Supported = false;
+    context->shaderInt16Supported = false;
+    if (context->physicalDeviceProperties.apiVersion >= VK_API_VERSION_1_2) {
+        descriptorIndexingFeatures.pNext = &bufferDeviceAddressFeatures;
+        bufferDeviceAddressFeatures.pNext = &timelineSemaphoreFeatures;
+        timelineSemaphoreFeatures.pNext = &storage16BitFeatures;
+        storage16BitFeatures.pNext = &storage8BitFeatures;
+        storage8BitFeatures.pNext = &float16Int8Features;
+        VkPhysicalDeviceFeatures2 features2 = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2};
+        features2.pNext = &descriptorIndexingFeatures;
+        vkGetPhysicalDeviceFeatures2(context->physicalDevice, &features2);
+
+        VkPhysicalDeviceDescriptorIndexingFeatures supported = descriptorIndexingFeatures;
+        descriptorIndexingFeatures = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES};
+        if (supported.runtimeDescriptorArray && supported.descriptorBindingPartiallyBound &&
+            supported.descriptorBindingStorageBufferUpdateAfterBind &&
+            supported.descriptorBindingStorageImageUpdateAfterBind &&
+            supported.descriptorBindingSampledImageUpdateAfterBind) {
+            descriptorIndexingFeatures.runtimeDescriptorArray = VK_TRUE;
+            descriptorIndexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+            descriptorIndexingFeatures.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+            descriptorIndexingFeatures.descriptorBindingStorageImageUpdateAfterBind = VK_TRUE;
+            descriptorIndexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+            descriptorIndexingFeatures.descriptorBindingUpdateUnusedWhilePending = supported.descriptorBindingUpdateUnusedWhilePending;
+            descriptorIndexingFeatures.shaderStorageBufferArrayNonUniformIndexing = supported.shaderStorageBufferArrayNonUniformIndexing;
+            descriptorIndexingFeatures.shaderStorageImageArrayNonUniformIndexing = supported.shaderStorageImageArrayNonUniformIndexing;
+            descriptorIndexingFeatures.shaderSampledImageArrayNonUniformIndexing = supported.shaderSampledImageArrayNonUniformIndexing;
+            // Indices from push constants are dynamically uniform, which is covered by the core dynamic indexing features
+            enabledFeatures.shaderStorageBufferArrayDynamicIndexing = features2.features.shaderStorageBufferArrayDynamicIndexing;
+            enabledFeatures.shaderStorageImageArrayDynamicIndexing = features2.features.shaderStorageImageArrayDynamicIndexing;
+            enabledFeatures.shaderSampledImageArrayDynamicIndexing = features2.features.shaderSampledImageArrayDynamicIndexing;
+            context->bindlessSupported = true;
+            context->bindlessUpdateUnusedWhilePending = supported.descriptorBindingUpdateUnusedWhilePending;
+        }
+
+        context->bufferDeviceAddressSupported = bufferDeviceAddressFeatures.bufferDeviceAddress;
+        bufferDeviceAddressFeatures.bufferDeviceAddressCaptureReplay = VK_FALSE;
+        bufferDeviceAddressFeatures.bufferDeviceAddressMultiDevice = VK_FALSE;
+
+        context->timelineSemaphoreSupported = timelineSemaphoreFeatures.timelineSemaphore;
+
+        // Storage buffers and push constants only, the compute pipelines have no shader inputs or outputs
+        context->storage16BitSupported = storage16BitFeatures.storageBuffer16BitAccess;
+        storage16BitFeatures.storageInputOutput16 = VK_FALSE;
+        context->storage8BitSupported = storage8BitFeatures.storageBuffer8BitAccess;
+        context->shaderFloat16Supported = float16Int8Features.shaderFloat16;
+        context->shaderInt8Supported = float16Int8Features.shaderInt8;
+        enabledFeatures.shaderInt16 = features2.features.shaderInt16;
+        context->shaderInt16Supported = features2.features.shaderInt16;
+
+        float16Int8Features.pNext = nullptr;
+        storage8BitFeatures.pNext = &float16Int8Features;
+        storage16BitFeatures.pNext = &storage8BitFeatures;
+        timelineSemaphoreFeatures.pNext = &storage16BitFeatures;
+        bufferDeviceAddressFeatures.pNext = &timelineSemaphoreFeatures;
+        descriptorIndexingFeatures.pNext = &bufferDeviceAddressFeatures;
+        enabledFeatureChain = &descriptorIndexingFeatures;
+    }
+    std::cout << "Bindless descriptors: " << (context->bindlessSupported ? "yes" : "no")
+        << ", buffer device address: " << (context->bufferDeviceAddressSupported ? "yes" : "no")
+        << ", timeline semaphores: " << (context->timelineSemaphoreSupported ? "yes" : "no") << std::endl;
+    std::cout << "16-bit storage: " << (context->storage16BitSupported ? "yes" : "no")
+        << ", 8-bit storage: " << (context->storage8BitSupported ? "yes" : "no")
+        << ", float16: " << (context->shaderFloat16Supported ? "yes" : "no")
+        << ", int8: " << (context->shaderInt8Supported ? "yes" : "no")
+        << ", int16: " << (context->shaderInt16Supported ? "yes" : "no") << std::endl;
+
+    // VK_EXT_memory_budget and VK_EXT_external_memory_host are enabled on top of the requested extensions whenever the device has them
+    std::vector<const char*> enabledExtensions(deviceExtensions, deviceExtensions + deviceExtensionCount);
+    context->memoryTracker.budgetExtensionEnabled = false;
+    context->hostImportSupported = false;
+    context->minImportedHostPointerAlignment = 0;
+    context->getMemoryHostPointerProperties = nullptr;
+    {
+        uint32_t extensionPropertyCount = 0;
+        vkEnumerateDeviceExtensionProperties(context->physicalDevice, 0, &extensionPropertyCount, 0);
+        std::vector<VkExtensionProperties> extensionProperties(extensionPropertyCount);
+        vkEnumerateDeviceExtensionProperties(context->physicalDevice, 0, &extensionPropertyCount, extensionProperties.data());
+        bool hostImportAvailable = false;
+        for (const VkExtensionProperties& properties : extensionProperties) {
+            if (strcmp(properties.extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0) {
+                context->memoryTracker.budgetExtensionEnabled = true;
+            }
+            if (strcmp(properties.extensionName, VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME) == 0) {
+                hostImportAvailable = true;
+            }
+        }
+        auto enableExtension = [&enabledExtensions](const char* name) {
+            for (const char* extension : enabledExtensions) {
+                if (strcmp(extension, name) == 0) {
+                    return;
+                }
+            }
+            enabledExtensions.push_back(name);
+        };
+        if (context->memoryTracker.budgetExtensionEnabled) {
+            enableExtension(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        }
+        // Builds on VK_KHR_external_memory, which is core since Vulkan 1.1
+        if (hostImportAvailable && context->physicalDeviceProperties.apiVersion >= VK_API_VERSION_1_1) {
+            enableExtension(VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME);
+            context->hostImportSupported = true;
+        }
+    }
+    std::cout << "Memory budget: " << (context->memoryTracker.budgetExtensionEnabled ? "yes" : "no")
+        << ", host memory import: " << (context->hostImportSupported ? "yes" : "no") << std::endl;
+
     VkDeviceCreateInfo createInfo = {VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO};
+    createInfo.pNext = enabledFeatureChain;
     createInfo.queueCreateInfoCount = 1;
     createInfo.pQueueCreateInfos = &queueCreateInfo;
-    createInfo.enabledExtensionCount = deviceExtensionCount;
-    createInfo.ppEnabledExtensionNames = deviceExtensions;
+    createInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
+    createInfo.ppEnabledExtensionNames = enabledExtensions.data();
     createInfo.pEnabledFeatures = &enabledFeatures;
     
     VkResult result = vkCreateDevice(context->physicalDevice, &createInfo, 0, &context->device);
@@ -123,6 +256,17 @@ bool createLogicalDevice(VulkanContext* context, uint32_t deviceExtensionCount,
     context->computeQueue.familyIndex = computeQueueIndex;
     vkGetDeviceQueue(context->device, computeQueueIndex, 0, &context->computeQueue.queue);
 
+    if (context->hostImportSupported) {
+        VkPhysicalDeviceExternalMemoryHostPropertiesEXT hostProperties = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_MEMORY_HOST_PROPERTIES_EXT};
+        VkPhysicalDeviceProperties2 properties2 = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2};
+        properties2.pNext = &hostProperties;
+        vkGetPhysicalDeviceProperties2(context->physicalDevice, &properties2);
+        context->minImportedHostPointerAlignment = hostProperties.minImportedHostPointerAlignment;
+        context->getMemoryHostPointerProperties = reinterpret_cast<PFN_vkGetMemoryHostPointerPropertiesEXT>(
+            vkGetDeviceProcAddr(context->device, "vkGetMemoryHostPointerPropertiesEXT"));
+        context->hostImportSupported = context->getMemoryHostPointerProperties != nullptr;
+    }
+
     return true;
 }
 
@@ -130,16 +274,17 @@ VulkanContext* initVulkan(uint32_t extensionCount, const char** extensions, uint
     VulkanContext* context = new VulkanContext;
 
     if(!initVulkanInstance(context, extensionCount, extensions)){
+        delete context;
         return 0;
     }
 
-    if(!selectPhysicalDevice(context)) {
-        return 0;
-    }
-
-    if(!createLogicalDevice(context, deviceExtensionCount, deviceExtensions)) {
+    if(!selectPhysicalDevice(context) || !createLogicalDevice(context, deviceExtensionCount, deviceExtensions)) {
+        vkDestroyInstance(context->instance, 0);
+        delete context;
         return 0;
     }
+    initMemoryTracker(context);
+    initSubmissionTracker(context);
 
     VkCommandPoolCreateInfo poolInfo{};
     poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
@@ -148,13 +293,20 @@ VulkanContext* initVulkan(uint32_t extensionCount, const char** extensions, uint
     if (vkCreateCommandPool(context->device, &poolInfo, nullptr, &context->commandPool) != VK_SUCCESS) {
         throw std::runtime_error("failed to create command pool!");
     }
+    context->threadCommandPools[std::this_thread::get_id()].commandPool = context->commandPool;
 
     return context;
 }
 
 void exitVulkan(VulkanContext* context) {
-    vkDestroyCommandPool(context->device, context->commandPool, 0);
-    vkDeviceWaitIdle(context->device);
+    // Every submission goes through submitCommandBuffers, so once the last one finished the device is idle
+    flushDeferredDestructions(context);
+    destroySubmissionTracker(context);
+    destroyThreadCommandPools(context);
+    if (!context->memoryTracker.allocations.empty()) {
+        LOG_WARN(context->memoryTracker.allocations.size() << " device memory allocations were not freed");
+    }
     vkDestroyDevice(context->device, 0);
     vkDestroyInstance(context->instance, 0);
-}
\ No newline at end of file
+    delete context;
+}
@@ -0,0 +1,323 @@
+#include "vulkan/vulkan_core.h"
+#include "vulkan_base.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+extern char** environ;
+#endif
+
+// Set by CMake to the compiler the build found
+#ifndef GLSLANG_VALIDATOR_PATH
+#define GLSLANG_VALIDATOR_PATH "glslangValidator"
+#endif
+
+#define FUSION_SETS_PER_POOL 16
+#define FUSION_GROUP_SIZE 256
+#define FUSION_MAX_GROUPS_X 65535
+
+static uint64_t hashChain(const std::vector<VulkanElementwiseStage>& stages) {
+    // FNV-1a over every expression and parameter count
+    uint64_t hash = 14695981039346656037ull;
+    auto hashBytes = [&hash](const void* data, size_t size) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; ++i) {
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+    };
+    for (const VulkanElementwiseStage& stage : stages) {
+        hashBytes(stage.expression.c_str(), stage.expression.size() + 1);
+        hashBytes(&stage.parameterCount, sizeof(stage.parameterCount));
+    }
+    return hash;
+}
+
+static std::string generateFusedShader(const std::vector<VulkanElementwiseStage>& stages, uint32_t parameterCount) {
+    std::ostringstream source;
+    source << "#version 450\n";
+    source << "// Generated by vulkan_fusion.cpp from " << stages.size() << " elementwise stages\n\n";
+    source << "layout(local_size_x = " << FUSION_GROUP_SIZE << ") in;\n\n";
+    source << "layout(set = 0, binding = 0) buffer Input {\n    float data[];\n} inputBuffer;\n\n";
+    source << "layout(set = 0, binding = 1) buffer Output {\n    float data[];\n} outputBuffer;\n\n";
+    source << "layout(push_constant) uniform PushConstants {\n    uint count;\n";
+    if (parameterCount > 0) {
+        source << "    float parameters[" << parameterCount << "];\n";
+    }
+    source << "} job;\n\n";
+
+    uint32_t firstParameter = 0;
+    for (size_t s = 0; s < stages.size(); ++s) {
+        source << "float stage" << s << "(float x, uint i) {\n";
+        for (uint32_t p = 0; p < stages[s].parameterCount; ++p) {
+            source << "    float p" << p << " = job.parameters[" << firstParameter + p << "];\n";
+        }
+        source << "    return float(" << stages[s].expression << ");\n}\n\n";
+        firstParameter += stages[s].parameterCount;
+    }
+
+    // Large inputs spill into the y dimension like the primitives do
+    source << "void main() {\n";
+    source << "    uint i = (gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x) * gl_WorkGroupSize.x + gl_LocalInvocationID.x;\n";
+    source << "    if (i >= job.count) {\n        return;\n    }\n";
+    source << "    float x = inputBuffer.data[i];\n";
+    for (size_t s = 0; s < stages.size(); ++s) {
+        source << "    x = stage" << s << "(x, i);\n";
+    }
+    source << "    outputBuffer.data[i] = x;\n}\n";
+    return source.str();
+}
+
+static bool readTextFile(const std::string& filename, std::string* text) {
+    FILE* file = fopen(filename.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    char buffer[4096];
+    size_t read;
+    text->clear();
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        text->append(buffer, read);
+    }
+    fclose(file);
+    return true;
+}
+
+static bool fileExists(const std::string& filename) {
+    FILE* file = fopen(filename.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    fclose(file);
+    return true;
+}
+
+// Replaces target with the file at path, rename() does not overwrite on Windows
+static bool moveFile(const std::string& path, const std::string& target) {
+    remove(target.c_str());
+    return rename(path.c_str(), target.c_str()) == 0;
+}
+
+// Runs the compiler without a shell, so paths are passed as they are. Returns whether it exited with 0
+static bool runShaderCompiler(const std::vector<std::string>& arguments) {
+#ifdef _WIN32
+    // Windows paths cannot contain quotes, so quoting every argument keeps them whole
+    std::string commandLine;
+    for (const std::string& argument : arguments) {
+        if (argument.find('"') != std::string::npos) {
+            return false;
+        }
+        commandLine += (commandLine.empty() ? "\"" : " \"") + argument + "\"";
+    }
+    STARTUPINFOA startupInfo = {};
+    startupInfo.cb = sizeof(startupInfo);
+    PROCESS_INFORMATION processInfo = {};
+    if (!CreateProcessA(NULL, &commandLine[0], NULL, NULL, FALSE, 0, NULL, NULL, &startupInfo, &processInfo)) {
+        return false;
+    }
+    WaitForSingleObject(processInfo.hProcess, INFINITE);
+    DWORD exitCode = 1;
+    GetExitCodeProcess(processInfo.hProcess, &exitCode);
+    CloseHandle(processInfo.hThread);
+    CloseHandle(processInfo.hProcess);
+    return exitCode == 0;
+#else
+    std::vector<char*> argv;
+    for (const std::string& argument : arguments) {
+        argv.push_back(const_cast<char*>(argument.c_str()));
+    }
+    argv.push_back(nullptr);
+    pid_t pid;
+    if (posix_spawnp(&pid, argv[0], nullptr, nullptr, argv.data(), environ) != 0) {
+        return false;
+    }
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            return false;
+        }
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+#endif
+}
+
+static unsigned long getProcessId() {
+#ifdef _WIN32
+    return GetCurrentProcessId();
+#else
+    return static_cast<unsigned long>(getpid());
+#endif
+}
+
+// Compiles the chain unless cacheDirectory already holds SPIR-V that was generated from the same source.
+// The shader is compiled under temporary names and the .comp is moved into place last, so a matching .comp
+// always sits next to a complete .spv even if the process dies during the compile
+static std::string compileFusedShader(VulkanFusionCache* cache, uint64_t hash, const std::string& source) {
+    char name[32];
+    snprintf(name, sizeof(name), "fused_%016llx", (unsigned long long)hash);
+    std::string basePath = cache->cacheDirectory + "/" + name;
+    std::string sourcePath = basePath + ".comp";
+    std::string spirvPath = basePath + ".spv";
+
+    std::string cachedSource;
+    if (readTextFile(sourcePath, &cachedSource) && cachedSource == source && fileExists(spirvPath)) {
+        return spirvPath;
+    }
+
+    // Processes sharing the cache directory compile under their own names
+    std::string tempBasePath = basePath + ".tmp" + std::to_string(getProcessId());
+    std::string tempSourcePath = tempBasePath + ".comp";
+    std::string tempSpirvPath = tempBasePath + ".spv";
+    FILE* file = fopen(tempSourcePath.c_str(), "wb");
+    if (!file) {
+        throw std::runtime_error("failed to write fused shader " + tempSourcePath);
+    }
+    fwrite(source.data(), 1, source.size(), file);
+    fclose(file);
+
+    if (!runShaderCompiler({GLSLANG_VALIDATOR_PATH, "-V", "--target-env", "vulkan1.1", "-S", "comp", tempSourcePath, "-o", tempSpirvPath})) {
+        remove(tempSpirvPath.c_str());
+        remove(tempSourcePath.c_str());
+        throw std::runtime_error("failed to compile fused shader " + sourcePath);
+    }
+    if (!moveFile(tempSpirvPath, spirvPath) || !moveFile(tempSourcePath, sourcePath)) {
+        remove(tempSpirvPath.c_str());
+        remove(tempSourcePath.c_str());
+        throw std::runtime_error("failed to move fused shader into " + cache->cacheDirectory);
+    }
+    LOG("Compiled fused shader " << spirvPath);
+    return spirvPath;
+}
+
+VulkanFusionCache* createFusionCache(VulkanContext* context, const char* cacheDirectory) {
+    if (cacheDirectory == nullptr || cacheDirectory[0] == '\0') {
+        throw std::runtime_error("fusion cache needs a writable cache directory");
+    }
+    VulkanFusionCache* cache = new VulkanFusionCache;
+    cache->cacheDirectory = cacheDirectory;
+
+    cache->descriptorSetInfo = initDescriptorSet();
+    addDescriptorSetLayout(cache->descriptorSetInfo, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    addDescriptorSetLayout(cache->descriptorSetInfo, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    createDescriptorSetLayout(context, cache->descriptorSetInfo);
+    cache->descriptorAllocator = createDescriptorAllocator(context, cache->descriptorSetInfo, FUSION_SETS_PER_POOL);
+    return cache;
+}
+
+VulkanFusedKernel* getFusedKernel(VulkanContext* context, VulkanFusionCache* cache, const std::vector<VulkanElementwiseStage>& stages) {
+    if (stages.empty()) {
+        throw std::runtime_error("fused kernel needs at least one stage");
+    }
+    uint64_t hash = hashChain(stages);
+    uint32_t parameterCount = 0;
+    for (const VulkanElementwiseStage& stage : stages) {
+        parameterCount += stage.parameterCount;
+    }
+    std::string source = generateFusedShader(stages, parameterCount);
+
+    std::lock_guard<std::mutex> lock(cache->mutex);
+    auto range = cache->kernels.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second->source == source) {
+            return it->second;
+        }
+    }
+
+    uint32_t pushConstantSize = sizeof(uint32_t) + parameterCount * sizeof(float);
+    if (pushConstantSize > context->physicalDeviceProperties.limits.maxPushConstantsSize) {
+        throw std::runtime_error("fused chain has more parameters than fit into push constants");
+    }
+
+    std::string spirvPath = compileFusedShader(cache, hash, source);
+
+    VulkanFusedKernel* kernel = new VulkanFusedKernel;
+    kernel->hash = hash;
+    kernel->source = source;
+    kernel->parameterCount = parameterCount;
+    // Group counts depend on the element count and are computed per call
+    kernel->pipeline = createPipeline(context, {spirvPath.c_str()}, {ivec3{1, 1, 1}}, cache->descriptorSetInfo, pushConstantSize);
+    cache->kernels.insert(std::make_pair(hash, kernel));
+    return kernel;
+}
+
+VkDescriptorSet allocateFusedDescriptorSet(VulkanContext* context, VulkanFusionCache* cache, VulkanBuffer* input, VulkanBuffer* output) {
+    VkDescriptorSet descriptorSet = allocateJobDescriptorSet(context, cache->descriptorAllocator);
+    VulkanDescriptorBufferInfo resources[2] = {describeBuffer(input), describeBuffer(output)};
+    updateJobDescriptorSet(context, cache->descriptorAllocator, descriptorSet, resources);
+    return descriptorSet;
+}
+
+void recordFusedKernel(VkCommandBuffer commandBuffer, VulkanFusedKernel* kernel, VkDescriptorSet descriptorSet, uint32_t count, const float* parameters) {
+    std::vector<uint32_t> pushConstants(1 + kernel->parameterCount);
+    pushConstants[0] = count;
+    if (kernel->parameterCount > 0) {
+        memcpy(&pushConstants[1], parameters, kernel->parameterCount * sizeof(float));
+    }
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, kernel->pipeline.pipelines[0]);
+    vkCmdBindDescriptorSets(
+        commandBuffer,
+        VK_PIPELINE_BIND_POINT_COMPUTE,
+        kernel->pipeline.pipelineLayout,
+        0,
+        1,
+        &descriptorSet,
+        0,
+        0
+    );
+    vkCmdPushConstants(commandBuffer, kernel->pipeline.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, kernel->pipeline.pushConstantSize, pushConstants.data());
+
+    uint32_t groupCount = (count + FUSION_GROUP_SIZE - 1) / FUSION_GROUP_SIZE;
+    uint32_t groupsX = groupCount < FUSION_MAX_GROUPS_X ? groupCount : FUSION_MAX_GROUPS_X;
+    uint32_t groupsY = (groupCount + FUSION_MAX_GROUPS_X - 1) / FUSION_MAX_GROUPS_X;
+    vkCmdDispatch(commandBuffer, groupsX > 0 ? groupsX : 1, groupsY > 0 ? groupsY : 1, 1);
+
+    // Later stages may read the results
+    VkMemoryBarrier barrier = {VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(
+        commandBuffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0,
+        1, &barrier,
+        0, nullptr,
+        0, nullptr
+    );
+}
+
+void runFusedKernel(VulkanContext* context, VulkanFusionCache* cache, const std::vector<VulkanElementwiseStage>& stages, VulkanBuffer* input, VulkanBuffer* output, uint32_t count, const std::vector<float>& parameters) {
+    VulkanFusedKernel* kernel = getFusedKernel(context, cache, stages);
+    if (parameters.size() != kernel->parameterCount) {
+        throw std::runtime_error("parameter count does not match the stages of the fused kernel");
+    }
+
+    VkDescriptorSet descriptorSet = allocateFusedDescriptorSet(context, cache, input, output);
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands(context);
+    recordFusedKernel(commandBuffer, kernel, descriptorSet, count, parameters.data());
+    endSingleTimeCommands(context, commandBuffer);
+    releaseJobDescriptorSet(cache->descriptorAllocator, descriptorSet);
+}
+
+void destroyFusionCache(VulkanContext* context, VulkanFusionCache* cache) {
+    for (auto& kernel : cache->kernels) {
+        destroyPipeline(context, &kernel.second->pipeline);
+        delete kernel.second;
+    }
+    destroyDescriptorAllocator(context, cache->descriptorAllocator);
+    destroyDescriptorSet(context, cache->descriptorSetInfo);
+    delete cache->descriptorSetInfo;
+    delete cache;
+}
@@ -16,35 +16,234 @@ uint32_t findMemoryType(VulkanContext* context, uint32_t typeFilter, VkMemoryPro
 	throw std::runtime_error("No matching avaialble memory type found");
 }
 
+static VulkanCommandPool* getThreadCommands(VulkanContext* context) {
+    std::lock_guard<std::mutex> lock(context->commandPoolMutex);
+    std::thread::id threadId = std::this_thread::get_id();
+    auto it = context->threadCommandPools.find(threadId);
+    if (it != context->threadCommandPools.end()) {
+        return &it->second;
+    }
+
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    poolInfo.queueFamilyIndex = context->computeQueue.familyIndex;
+
+    VulkanCommandPool& threadCommands = context->threadCommandPools[threadId];
+    if (vkCreateCommandPool(context->device, &poolInfo, nullptr, &threadCommands.commandPool) != VK_SUCCESS) {
+        context->threadCommandPools.erase(threadId);
+        throw std::runtime_error("failed to create command pool!");
+    }
+    return &threadCommands;
+}
+
+static void destroyCommandPool(VulkanContext* context, VulkanCommandPool* threadCommands) {
+    for (VkFence fence : threadCommands->transferFences) {
+        vkDestroyFence(context->device, fence, 0);
+    }
+    vkDestroyCommandPool(context->device, threadCommands->commandPool, 0);
+}
+
+VkCommandPool getThreadCommandPool(VulkanContext* context) {
+    return getThreadCommands(context)->commandPool;
+}
+
+// For worker threads that exit before the context, all their command buffers must have finished executing
+void releaseThreadCommandPool(VulkanContext* context) {
+    std::lock_guard<std::mutex> lock(context->commandPoolMutex);
+    auto it = context->threadCommandPools.find(std::this_thread::get_id());
+    if (it == context->threadCommandPools.end() || it->second.commandPool == context->commandPool) {
+        return;
+    }
+    destroyCommandPool(context, &it->second);
+    context->threadCommandPools.erase(it);
+}
+
+void destroyThreadCommandPools(VulkanContext* context) {
+    std::lock_guard<std::mutex> lock(context->commandPoolMutex);
+    for (auto& threadCommands : context->threadCommandPools) {
+        destroyCommandPool(context, &threadCommands.second);
+    }
+    context->threadCommandPools.clear();
+}
+
+uint64_t submitCommandBuffers(VulkanContext* context, uint32_t commandBufferCount, const VkCommandBuffer* commandBuffers, VkFence fence) {
+    collectDeferredDestructions(context);
+
+    VulkanSubmissionTracker* submissions = &context->submissions;
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = commandBufferCount;
+    submitInfo.pCommandBuffers = commandBuffers;
+
+    std::lock_guard<std::mutex> lock(context->queueMutex);
+    uint64_t submission = submissions->submittedValue + 1;
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo = {VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO};
+    if (submissions->timeline != VK_NULL_HANDLE) {
+        timelineInfo.signalSemaphoreValueCount = 1;
+        timelineInfo.pSignalSemaphoreValues = &submission;
+        submitInfo.pNext = &timelineInfo;
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = &submissions->timeline;
+        if (vkQueueSubmit(context->computeQueue.queue, 1, &submitInfo, fence) != VK_SUCCESS) {
+            throw std::runtime_error("failed to submit command buffers!");
+        }
+        submissions->submittedValue = submission;
+        return submission;
+    }
+
+    // Without timeline semaphores every submission is tracked by a fence of our own. When the caller passes a fence,
+    // an empty submission signals ours, which happens after all previously submitted work has finished
+    VkFence trackingFence;
+    if (!submissions->freeFences.empty()) {
+        trackingFence = submissions->freeFences.back();
+        submissions->freeFences.pop_back();
+    } else {
+        VkFenceCreateInfo fenceInfo = {VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
+        if (vkCreateFence(context->device, &fenceInfo, 0, &trackingFence) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create submission fence!");
+        }
+    }
+    VkResult result = vkQueueSubmit(context->computeQueue.queue, 1, &submitInfo, fence != VK_NULL_HANDLE ? fence : trackingFence);
+    if (result == VK_SUCCESS && fence != VK_NULL_HANDLE) {
+        result = vkQueueSubmit(context->computeQueue.queue, 0, nullptr, trackingFence);
+    }
+    if (result != VK_SUCCESS) {
+        submissions->freeFences.push_back(trackingFence);
+        throw std::runtime_error("failed to submit command buffers!");
+    }
+    submissions->submittedValue = submission;
+    submissions->pendingFences.push_back(std::make_pair(submission, trackingFence));
+    return submission;
+}
+
+void waitQueueIdle(VulkanContext* context) {
+    std::lock_guard<std::mutex> lock(context->queueMutex);
+    vkQueueWaitIdle(context->computeQueue.queue);
+}
+
+// Command buffers are reset through the RESET flag of the pool and reused together with their fence,
+// so a transfer only waits for its own submission instead of the whole queue
 VkCommandBuffer beginSingleTimeCommands(VulkanContext* context) {
+    VulkanCommandPool* threadCommands = getThreadCommands(context);
+
+    uint32_t index;
+    if (!threadCommands->freeTransfers.empty()) {
+        index = threadCommands->freeTransfers.back();
+        threadCommands->freeTransfers.pop_back();
+        vkResetCommandBuffer(threadCommands->transferCommandBuffers[index], 0);
+    } else {
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandPool = threadCommands->commandPool;
+        allocInfo.commandBufferCount = 1;
+
+        VkCommandBuffer commandBuffer;
+        if (vkAllocateCommandBuffers(context->device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate transfer command buffer");
+        }
+
+        VkFenceCreateInfo fenceInfo = {VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
+        VkFence fence;
+        if (vkCreateFence(context->device, &fenceInfo, 0, &fence) != VK_SUCCESS) {
+            vkFreeCommandBuffers(context->device, threadCommands->commandPool, 1, &commandBuffer);
+            throw std::runtime_error("failed to create transfer fence");
+        }
+
+        index = static_cast<uint32_t>(threadCommands->transferCommandBuffers.size());
+        threadCommands->transferCommandBuffers.push_back(commandBuffer);
+        threadCommands->transferFences.push_back(fence);
+    }
+
+    VkCommandBuffer commandBuffer = threadCommands->transferCommandBuffers[index];
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+    return commandBuffer;
+}
+
+void endSingleTimeCommands(VulkanContext* context, VkCommandBuffer commandBuffer) {
+    VulkanCommandPool* threadCommands = getThreadCommands(context);
+
+    uint32_t index = 0;
+    while (index < threadCommands->transferCommandBuffers.size() && threadCommands->transferCommandBuffers[index] != commandBuffer) {
+        ++index;
+    }
+    if (index == threadCommands->transferCommandBuffers.size()) {
+        throw std::runtime_error("command buffer was not started with beginSingleTimeCommands on this thread");
+    }
+    VkFence fence = threadCommands->transferFences[index];
+
+    vkEndCommandBuffer(commandBuffer);
+
+    try {
+        submitCommandBuffers(context, 1, &commandBuffer, fence);
+    } catch (...) {
+        // The command buffer may still have been submitted before the tracking submission failed,
+        // so the slot only goes back once the queue is idle
+        waitQueueIdle(context);
+        vkResetFences(context->device, 1, &fence);
+        threadCommands->freeTransfers.push_back(index);
+        throw;
+    }
+    VkResult result = vkWaitForFences(context->device, 1, &fence, VK_TRUE, UINT64_MAX);
+    vkResetFences(context->device, 1, &fence);
+    threadCommands->freeTransfers.push_back(index);
+
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("failed to wait for transfer fence");
+    }
+}
+
+VkCommandBuffer beginSecondaryCommands(VulkanContext* context) {
     VkCommandBufferAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandPool = context->commandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+    allocInfo.commandPool = getThreadCommandPool(context);
     allocInfo.commandBufferCount = 1;
 
     VkCommandBuffer commandBuffer;
-    vkAllocateCommandBuffers(context->device, &allocInfo, &commandBuffer);
+    if (vkAllocateCommandBuffers(context->device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate secondary command buffer");
+    }
+
+    // Compute work does not inherit any render pass state
+    VkCommandBufferInheritanceInfo inheritanceInfo{};
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
 
     VkCommandBufferBeginInfo beginInfo{};
     beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
     beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    beginInfo.pInheritanceInfo = &inheritanceInfo;
 
     vkBeginCommandBuffer(commandBuffer, &beginInfo);
 
     return commandBuffer;
 }
 
-void endSingleTimeCommands(VulkanContext* context, VkCommandBuffer commandBuffer) {
-    vkEndCommandBuffer(commandBuffer);
-
-    VkSubmitInfo submitInfo{};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffer;
+void endSecondaryCommands(VkCommandBuffer commandBuffer) {
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to record secondary command buffer!");
+    }
+}
 
-    vkQueueSubmit(context->computeQueue.queue, 1, &submitInfo, VK_NULL_HANDLE);
-    vkQueueWaitIdle(context->computeQueue.queue);
+void executeSecondaryCommands(VkCommandBuffer primaryCommandBuffer, const std::vector<VkCommandBuffer>& secondaryCommandBuffers) {
+    if (secondaryCommandBuffers.empty()) {
+        return;
+    }
+    vkCmdExecuteCommands(primaryCommandBuffer, static_cast<uint32_t>(secondaryCommandBuffers.size()), secondaryCommandBuffers.data());
+}
 
-    vkFreeCommandBuffers(context->device, context->commandPool, 1, &commandBuffer);
-}
\ No newline at end of file
+// Frees command buffers of the calling thread once they finished executing
+void freeThreadCommandBuffers(VulkanContext* context, const std::vector<VkCommandBuffer>& commandBuffers) {
+    if (commandBuffers.empty()) {
+        return;
+    }
+    vkFreeCommandBuffers(context->device, getThreadCommandPool(context), static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
+}
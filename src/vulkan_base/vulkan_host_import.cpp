@@ -0,0 +1,216 @@
+#include "vulkan/vulkan_core.h"
+#include "vulkan_base.h"
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <malloc.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static size_t getPageSize() {
+#ifdef _WIN32
+    SYSTEM_INFO systemInfo;
+    GetSystemInfo(&systemInfo);
+    return systemInfo.dwPageSize;
+#else
+    return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+}
+
+static size_t alignUp(size_t size, size_t alignment) {
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+VkDeviceSize getHostImportAlignment(VulkanContext* context) {
+    VkDeviceSize pageSize = getPageSize();
+    if (context->hostImportSupported && context->minImportedHostPointerAlignment > pageSize) {
+        return context->minImportedHostPointerAlignment;
+    }
+    return pageSize;
+}
+
+void* allocateHostImportMemory(VulkanContext* context, size_t size) {
+    size_t alignment = static_cast<size_t>(getHostImportAlignment(context));
+    size_t paddedSize = alignUp(size > 0 ? size : 1, alignment);
+#ifdef _WIN32
+    void* memory = _aligned_malloc(paddedSize, alignment);
+#else
+    void* memory = nullptr;
+    if (posix_memalign(&memory, alignment, paddedSize) != 0) {
+        memory = nullptr;
+    }
+#endif
+    if (memory == nullptr) {
+        throw std::runtime_error("failed to allocate host memory for import");
+    }
+    return memory;
+}
+
+void freeHostImportMemory(void* memory) {
+#ifdef _WIN32
+    _aligned_free(memory);
+#else
+    free(memory);
+#endif
+}
+
+// Returns false when the device cannot import the memory, the caller then stages the data instead
+static bool importHostMemory(VulkanContext* context, VulkanBuffer* buffer, void* hostPointer, size_t size, size_t availableSize, VkBufferUsageFlags usage) {
+    if (!context->hostImportSupported) {
+        return false;
+    }
+    VkDeviceSize alignment = context->minImportedHostPointerAlignment;
+    VkDeviceSize importSize = alignUp(size, alignment);
+    if (reinterpret_cast<uintptr_t>(hostPointer) % alignment != 0 || importSize > availableSize) {
+        return false;
+    }
+
+    VkMemoryHostPointerPropertiesEXT pointerProperties = {VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT};
+    if (context->getMemoryHostPointerProperties(context->device, VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT, hostPointer, &pointerProperties) != VK_SUCCESS) {
+        return false;
+    }
+
+    VkExternalMemoryBufferCreateInfo externalInfo = {VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO};
+    externalInfo.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+    VkBufferCreateInfo createInfo = {VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+    createInfo.pNext = &externalInfo;
+    createInfo.size = size;
+    createInfo.usage = usage;
+    if (vkCreateBuffer(context->device, &createInfo, 0, &buffer->buffer) != VK_SUCCESS) {
+        return false;
+    }
+
+    VkMemoryRequirements memoryRequirements;
+    vkGetBufferMemoryRequirements(context->device, buffer->buffer, &memoryRequirements);
+    memoryRequirements.memoryTypeBits &= pointerProperties.memoryTypeBits;
+    if (memoryRequirements.memoryTypeBits == 0 || memoryRequirements.size > importSize) {
+        vkDestroyBuffer(context->device, buffer->buffer, 0);
+        return false;
+    }
+    // The allocation is the imported range itself
+    memoryRequirements.size = importSize;
+
+    VkImportMemoryHostPointerInfoEXT importInfo = {VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT};
+    importInfo.handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+    importInfo.pHostPointer = hostPointer;
+    try {
+        buffer->memory = allocateMemory(context, memoryRequirements, 0, false, &importInfo);
+    } catch (const std::runtime_error&) {
+        vkDestroyBuffer(context->device, buffer->buffer, 0);
+        return false;
+    }
+    vkBindBufferMemory(context->device, buffer->buffer, buffer->memory, 0);
+    return true;
+}
+
+static bool importOrStage(VulkanContext* context, VulkanBuffer* buffer, void* hostPointer, size_t size, size_t availableSize, VkBufferUsageFlags usage) {
+    if (importHostMemory(context, buffer, hostPointer, size, availableSize, usage)) {
+        return true;
+    }
+    // createBuffer() takes 32-bit sizes, larger data could only be imported
+    if (size > UINT32_MAX) {
+        throw std::runtime_error("host memory over 4 GiB cannot be imported by this device and is too large to stage");
+    }
+    createBuffer(context, buffer, static_cast<uint32_t>(size), usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    uploadDataToBufferWithStagingBuffer(context, buffer, hostPointer, size);
+    return false;
+}
+
+bool importHostBuffer(VulkanContext* context, VulkanBuffer* buffer, void* hostPointer, size_t size, VkBufferUsageFlags usage) {
+    return importOrStage(context, buffer, hostPointer, size, alignUp(size, static_cast<size_t>(getHostImportAlignment(context))), usage);
+}
+
+void mapFileForImport(VulkanContext* context, VulkanMappedFile* file, const char* filename) {
+#ifdef _WIN32
+    HANDLE fileHandle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (fileHandle == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error(std::string("failed to open ") + filename);
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0) {
+        CloseHandle(fileHandle);
+        throw std::runtime_error(std::string("failed to map empty file ") + filename);
+    }
+    // Copy-on-write views cannot extend past the end of the file, so only the last page is padded
+    HANDLE mapping = CreateFileMappingA(fileHandle, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    void* data = mapping ? MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0) : NULL;
+    if (mapping) {
+        CloseHandle(mapping);
+    }
+    CloseHandle(fileHandle);
+    if (data == NULL) {
+        throw std::runtime_error(std::string("failed to map ") + filename);
+    }
+    file->data = data;
+    file->size = static_cast<size_t>(fileSize.QuadPart);
+    file->mappedSize = alignUp(file->size, getPageSize());
+#else
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error(std::string("failed to open ") + filename);
+    }
+    struct stat fileStatus;
+    if (fstat(fd, &fileStatus) != 0 || fileStatus.st_size == 0) {
+        close(fd);
+        throw std::runtime_error(std::string("failed to map empty file ") + filename);
+    }
+    size_t size = static_cast<size_t>(fileStatus.st_size);
+    size_t pageSize = getPageSize();
+    size_t alignment = static_cast<size_t>(getHostImportAlignment(context));
+    size_t mappedSize = alignUp(size, alignment);
+
+    // Pages past the end of the file would fault, so the padding comes from anonymous memory that the file is mapped over.
+    // mmap only aligns to pages, so a larger import alignment is found inside a bigger reservation and the slack is unmapped.
+    // Writable copy-on-write pages let drivers pin them for the import
+    size_t reservedSize = mappedSize + (alignment > pageSize ? alignment - pageSize : 0);
+    void* data = mmap(nullptr, reservedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data != MAP_FAILED) {
+        char* reservation = static_cast<char*>(data);
+        char* aligned = reinterpret_cast<char*>(alignUp(reinterpret_cast<uintptr_t>(reservation), alignment));
+        if (aligned > reservation) {
+            munmap(reservation, aligned - reservation);
+        }
+        if (aligned + mappedSize < reservation + reservedSize) {
+            munmap(aligned + mappedSize, reservation + reservedSize - (aligned + mappedSize));
+        }
+        data = aligned;
+        if (mmap(data, alignUp(size, pageSize), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+            munmap(data, mappedSize);
+            data = MAP_FAILED;
+        }
+    }
+    close(fd);
+    if (data == MAP_FAILED) {
+        throw std::runtime_error(std::string("failed to map ") + filename);
+    }
+    file->data = data;
+    file->size = size;
+    file->mappedSize = mappedSize;
+#endif
+}
+
+bool importFileBuffer(VulkanContext* context, VulkanBuffer* buffer, VulkanMappedFile* file, VkBufferUsageFlags usage) {
+    return importOrStage(context, buffer, file->data, file->size, file->mappedSize, usage);
+}
+
+void unmapFile(VulkanMappedFile* file) {
+#ifdef _WIN32
+    UnmapViewOfFile(file->data);
+#else
+    munmap(file->data, file->mappedSize);
+#endif
+    file->data = nullptr;
+    file->size = 0;
+    file->mappedSize = 0;
+}
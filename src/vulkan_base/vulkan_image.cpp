@@ -1,7 +1,154 @@
 #include "vulkan/vulkan_core.h"
 #include "vulkan_base.h"
+#include <cstring>
 #include <stdexcept>
 
+// Images that are only sampled live in SHADER_READ_ONLY_OPTIMAL, everything else stays in GENERAL for imageLoad/imageStore
+VkImageLayout getShaderImageLayout(VulkanImage* image) {
+    if (image->usage & VK_IMAGE_USAGE_STORAGE_BIT) {
+        return VK_IMAGE_LAYOUT_GENERAL;
+    }
+    return VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+}
+
+bool supportsStorageImageFormat(VulkanContext* context, VkFormat format) {
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(context->physicalDevice, format, &formatProperties);
+    return (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT) != 0;
+}
+
+uint32_t getFormatTexelSize(VkFormat format) {
+    switch (format) {
+        case VK_FORMAT_R8_UNORM:
+        case VK_FORMAT_R8_SNORM:
+        case VK_FORMAT_R8_UINT:
+        case VK_FORMAT_R8_SINT:
+            return 1;
+        case VK_FORMAT_R8G8_UNORM:
+        case VK_FORMAT_R8G8_SNORM:
+        case VK_FORMAT_R8G8_UINT:
+        case VK_FORMAT_R8G8_SINT:
+        case VK_FORMAT_R16_UNORM:
+        case VK_FORMAT_R16_SNORM:
+        case VK_FORMAT_R16_UINT:
+        case VK_FORMAT_R16_SINT:
+        case VK_FORMAT_R16_SFLOAT:
+            return 2;
+        case VK_FORMAT_R8G8B8A8_UNORM:
+        case VK_FORMAT_R8G8B8A8_SNORM:
+        case VK_FORMAT_R8G8B8A8_UINT:
+        case VK_FORMAT_R8G8B8A8_SINT:
+        case VK_FORMAT_R8G8B8A8_SRGB:
+        case VK_FORMAT_B8G8R8A8_UNORM:
+        case VK_FORMAT_B8G8R8A8_SRGB:
+        case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+        case VK_FORMAT_A2B10G10R10_UINT_PACK32:
+        case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+        case VK_FORMAT_R16G16_UNORM:
+        case VK_FORMAT_R16G16_SNORM:
+        case VK_FORMAT_R16G16_UINT:
+        case VK_FORMAT_R16G16_SINT:
+        case VK_FORMAT_R16G16_SFLOAT:
+        case VK_FORMAT_R32_UINT:
+        case VK_FORMAT_R32_SINT:
+        case VK_FORMAT_R32_SFLOAT:
+            return 4;
+        case VK_FORMAT_R16G16B16A16_UNORM:
+        case VK_FORMAT_R16G16B16A16_SNORM:
+        case VK_FORMAT_R16G16B16A16_UINT:
+        case VK_FORMAT_R16G16B16A16_SINT:
+        case VK_FORMAT_R16G16B16A16_SFLOAT:
+        case VK_FORMAT_R32G32_UINT:
+        case VK_FORMAT_R32G32_SINT:
+        case VK_FORMAT_R32G32_SFLOAT:
+            return 8;
+        case VK_FORMAT_R32G32B32_UINT:
+        case VK_FORMAT_R32G32B32_SINT:
+        case VK_FORMAT_R32G32B32_SFLOAT:
+            return 12;
+        case VK_FORMAT_R32G32B32A32_UINT:
+        case VK_FORMAT_R32G32B32A32_SINT:
+        case VK_FORMAT_R32G32B32A32_SFLOAT:
+            return 16;
+        default:
+            throw std::runtime_error("unknown texel size of image format");
+    }
+}
+
+// Expects the whole mip chain in TRANSFER_DST_OPTIMAL with level 0 filled, leaves every level in TRANSFER_SRC_OPTIMAL
+void recordMipmapGeneration(VulkanContext* context, VulkanImage* image, VkCommandBuffer commandBuffer) {
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(context->physicalDevice, image->format, &formatProperties);
+    if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)) {
+        throw std::runtime_error("image format does not support linear blitting for mipmap generation!");
+    }
+
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.image = image->image;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+    int32_t mipWidth = static_cast<int32_t>(image->extent.width);
+    int32_t mipHeight = static_cast<int32_t>(image->extent.height);
+
+    for (uint32_t i = 1; i < image->mipLevels; ++i) {
+        barrier.subresourceRange.baseMipLevel = i - 1;
+        vkCmdPipelineBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0,
+            0, nullptr,
+            0, nullptr,
+            1, &barrier
+        );
+
+        VkImageBlit blit{};
+        blit.srcOffsets[0] = {0, 0, 0};
+        blit.srcOffsets[1] = {mipWidth, mipHeight, 1};
+        blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        blit.srcSubresource.mipLevel = i - 1;
+        blit.srcSubresource.baseArrayLayer = 0;
+        blit.srcSubresource.layerCount = 1;
+        blit.dstOffsets[0] = {0, 0, 0};
+        blit.dstOffsets[1] = {mipWidth > 1 ? mipWidth / 2 : 1, mipHeight > 1 ? mipHeight / 2 : 1, 1};
+        blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        blit.dstSubresource.mipLevel = i;
+        blit.dstSubresource.baseArrayLayer = 0;
+        blit.dstSubresource.layerCount = 1;
+
+        vkCmdBlitImage(
+            commandBuffer,
+            image->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            image->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            1, &blit,
+            VK_FILTER_LINEAR
+        );
+
+        if (mipWidth > 1) mipWidth /= 2;
+        if (mipHeight > 1) mipHeight /= 2;
+    }
+
+    barrier.subresourceRange.baseMipLevel = image->mipLevels - 1;
+    vkCmdPipelineBarrier(
+        commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0,
+        0, nullptr,
+        0, nullptr,
+        1, &barrier
+    );
+    image->currentLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+}
+
 void copyBufferToImage(VulkanContext* context, VulkanBuffer* buffer, VulkanImage* image) {
     VkCommandBuffer commandBuffer = beginSingleTimeCommands(context);
     transitionLayout(context, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, commandBuffer);
@@ -25,12 +172,16 @@ void copyBufferToImage(VulkanContext* context, VulkanBuffer* buffer, VulkanImage
         1,
         &region
     );
-    
-    transitionLayout(context, image, VK_IMAGE_LAYOUT_GENERAL, commandBuffer);
+
+    if (image->mipLevels > 1) {
+        recordMipmapGeneration(context, image, commandBuffer);
+    }
+
+    transitionLayout(context, image, getShaderImageLayout(image), commandBuffer);
     endSingleTimeCommands(context, commandBuffer);
 }
 
-void copyImageToBuffer(VulkanContext* context, VulkanImage* image, VulkanBuffer* buffer) {
+void copyImageToBuffer(VulkanContext* context, VulkanImage* image, VulkanBuffer* buffer, VkOffset3D offset, VkExtent3D extent) {
     VkCommandBuffer commandBuffer = beginSingleTimeCommands(context);
     transitionLayout(context, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, commandBuffer);
 
@@ -42,8 +193,8 @@ void copyImageToBuffer(VulkanContext* context, VulkanImage* image, VulkanBuffer*
     region.imageSubresource.mipLevel = 0;
     region.imageSubresource.baseArrayLayer = 0;
     region.imageSubresource.layerCount = 1;
-    region.imageOffset = {0, 0, 0};
-    region.imageExtent = image->extent;
+    region.imageOffset = offset;
+    region.imageExtent = extent;
 
     vkCmdCopyImageToBuffer(
         commandBuffer,
@@ -54,19 +205,24 @@ void copyImageToBuffer(VulkanContext* context, VulkanImage* image, VulkanBuffer*
         &region
     );
 
-    transitionLayout(context, image, VK_IMAGE_LAYOUT_GENERAL, commandBuffer);
+    transitionLayout(context, image, getShaderImageLayout(image), commandBuffer);
     endSingleTimeCommands(context, commandBuffer);
 }
 
 
-void createImage(VulkanContext* context, VulkanImage* image, size_t size, uint32_t width, uint32_t height, uint32_t depth, VkFormat format, VkImageUsageFlags usage, VkMemoryPropertyFlags memoryProperties) {
+void createImage(VulkanContext* context, VulkanImage* image, size_t size, uint32_t width, uint32_t height, uint32_t depth, uint32_t mipLevels, VkFormat format, VkImageUsageFlags usage, VkMemoryPropertyFlags memoryProperties) {
+    if (mipLevels > 1) {
+        // Mip levels are generated by blitting from the previous level
+        usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    }
+
     VkImageCreateInfo imageInfo{};
     imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
     imageInfo.imageType = VK_IMAGE_TYPE_2D;
     imageInfo.extent.width = width;
     imageInfo.extent.height = height;
     imageInfo.extent.depth = depth;
-    imageInfo.mipLevels = 1;
+    imageInfo.mipLevels = mipLevels;
     imageInfo.arrayLayers = 1;
     imageInfo.format = format;
     imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
@@ -76,6 +232,9 @@ void createImage(VulkanContext* context, VulkanImage* image, size_t size, uint32
     imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
     image->extent = imageInfo.extent;
     image->size = size;
+    image->format = format;
+    image->usage = usage;
+    image->mipLevels = mipLevels;
 
     if (vkCreateImage(context->device, &imageInfo, nullptr, &image->image) != VK_SUCCESS) {
         throw std::runtime_error("failed to create image!");
@@ -84,13 +243,11 @@ void createImage(VulkanContext* context, VulkanImage* image, size_t size, uint32
     VkMemoryRequirements memRequirements;
     vkGetImageMemoryRequirements(context->device, image->image, &memRequirements);
 
-    VkMemoryAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = findMemoryType(context, memRequirements.memoryTypeBits, memoryProperties);
-
-    if (vkAllocateMemory(context->device, &allocInfo, nullptr, &image->memory) != VK_SUCCESS) {
-        throw std::runtime_error("failed to allocate image memory!");
+    try {
+        image->memory = allocateMemory(context, memRequirements, memoryProperties, false);
+    } catch (const std::runtime_error&) {
+        vkDestroyImage(context->device, image->image, nullptr);
+        throw;
     }
 
     vkBindImageMemory(context->device, image->image, image->memory, 0);
@@ -102,7 +259,7 @@ void createImage(VulkanContext* context, VulkanImage* image, size_t size, uint32
     viewInfo.format = format;
     viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
     viewInfo.subresourceRange.baseMipLevel = 0;
-    viewInfo.subresourceRange.levelCount = 1;
+    viewInfo.subresourceRange.levelCount = mipLevels;
     viewInfo.subresourceRange.baseArrayLayer = 0;
     viewInfo.subresourceRange.layerCount = 1;
 
@@ -129,8 +286,7 @@ void uploadDataToImageWithStagingBuffer(VulkanContext* context, VulkanImage* ima
 
     copyBufferToImage(context, &stagingBuffer, image);
 
-    vkDestroyBuffer(context->device, stagingBuffer.buffer, 0);
-    vkFreeMemory(context->device, stagingBuffer.memory, 0);
+    destroyBuffer(context, &stagingBuffer);
 }
 
 void transitionLayout(VulkanContext* context, VulkanImage* image, VkImageLayout newLayout, VkCommandBuffer commandBuffer) {
@@ -143,7 +299,7 @@ void transitionLayout(VulkanContext* context, VulkanImage* image, VkImageLayout
     barrier.image = image->image;
     barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
     barrier.subresourceRange.baseMipLevel = 0;
-    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.levelCount = image->mipLevels;
     barrier.subresourceRange.baseArrayLayer = 0;
     barrier.subresourceRange.layerCount = 1;
 
@@ -174,7 +330,25 @@ void transitionLayout(VulkanContext* context, VulkanImage* image, VkImageLayout
 
         sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
         destinationStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
-    }else {
+    } else if ((image->currentLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL || image->currentLayout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL) && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+        sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        destinationStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    } else if (image->currentLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL) {
+        barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+        sourceStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    } else if (image->currentLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == getShaderImageLayout(image)) {
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+        sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+        destinationStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    } else {
         throw std::invalid_argument("unsupported layout transition!");
     }
 
@@ -189,29 +363,73 @@ void transitionLayout(VulkanContext* context, VulkanImage* image, VkImageLayout
     image->currentLayout = newLayout;
 }
 
-void getDataFromImageWithStagingBuffer(VulkanContext* context, VulkanImage* image, void* data) {
+void getImageRegionWithStagingBuffer(VulkanContext* context, VulkanImage* image, void* data, VkOffset3D offset, VkExtent3D extent) {
+    if (offset.x < 0 || offset.y < 0 || offset.z < 0 ||
+        offset.x + extent.width > image->extent.width ||
+        offset.y + extent.height > image->extent.height ||
+        offset.z + extent.depth > image->extent.depth) {
+        throw std::runtime_error("image readback region is outside of the image");
+    }
+    size_t texelSize = getFormatTexelSize(image->format);
+    size_t size = texelSize * extent.width * extent.height * extent.depth;
+
     VulkanBuffer stagingBuffer;
-    createBuffer(
-        context,
-        &stagingBuffer,
-        image->size,
-        VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-    );
+    createReadbackBuffer(context, &stagingBuffer, size);
 
-    copyImageToBuffer(context, image, &stagingBuffer);
+    copyImageToBuffer(context, image, &stagingBuffer, offset, extent);
 
     void* mapped;
-    vkMapMemory(context->device, stagingBuffer.memory, 0, image->size, 0, &mapped);
-    memcpy(data, mapped, image->size);
+    vkMapMemory(context->device, stagingBuffer.memory, 0, VK_WHOLE_SIZE, 0, &mapped);
+    invalidateMappedBuffer(context, &stagingBuffer);
+    memcpy(data, mapped, size);
     vkUnmapMemory(context->device, stagingBuffer.memory);
 
-    vkDestroyBuffer(context->device, stagingBuffer.buffer, nullptr);
-    vkFreeMemory(context->device, stagingBuffer.memory, nullptr);
+    destroyBuffer(context, &stagingBuffer);
+}
+
+void getDataFromImageWithStagingBuffer(VulkanContext* context, VulkanImage* image, void* data) {
+    getImageRegionWithStagingBuffer(context, image, data, {0, 0, 0}, image->extent);
 }
 
 void destroyImage(VulkanContext* context, VulkanImage* image) {
     vkDestroyImageView(context->device, image->view, 0);
     vkDestroyImage(context->device, image->image, 0);
-    vkFreeMemory(context->device, image->memory, 0);
+    freeMemory(context, image->memory);
+}
+
+uint32_t calculateMipLevels(uint32_t width, uint32_t height) {
+    uint32_t levels = 1;
+    uint32_t size = width > height ? width : height;
+    while (size > 1) {
+        size >>= 1;
+        ++levels;
+    }
+    return levels;
+}
+
+VkSampler createSampler(VulkanContext* context, VkFilter filter, VkSamplerAddressMode addressMode, uint32_t mipLevels) {
+    VkSamplerCreateInfo createInfo = {VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
+    createInfo.magFilter = filter;
+    createInfo.minFilter = filter;
+    createInfo.mipmapMode = filter == VK_FILTER_LINEAR ? VK_SAMPLER_MIPMAP_MODE_LINEAR : VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    createInfo.addressModeU = addressMode;
+    createInfo.addressModeV = addressMode;
+    createInfo.addressModeW = addressMode;
+    createInfo.mipLodBias = 0.0f;
+    createInfo.anisotropyEnable = VK_FALSE;
+    createInfo.compareEnable = VK_FALSE;
+    createInfo.minLod = 0.0f;
+    createInfo.maxLod = static_cast<float>(mipLevels);
+    createInfo.borderColor = VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK;
+    createInfo.unnormalizedCoordinates = VK_FALSE;
+
+    VkSampler sampler;
+    if (vkCreateSampler(context->device, &createInfo, 0, &sampler) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create sampler!");
+    }
+    return sampler;
+}
+
+void destroySampler(VulkanContext* context, VkSampler sampler) {
+    vkDestroySampler(context->device, sampler, 0);
 }
@@ -0,0 +1,45 @@
+#include "vulkan/vulkan_core.h"
+#include "vulkan_base.h"
+#include <cstring>
+#include <stdexcept>
+
+#define FILTER_TILE_SIZE 16
+// Keeps the (16 + 2 * radius) x 16 vec4 tile within the 16KB of shared memory every device offers
+#define FILTER_MAX_RADIUS 16
+
+static ivec3 getFilterDispatch(uint32_t width, uint32_t height) {
+    return ivec3{
+        (int)((width + FILTER_TILE_SIZE - 1) / FILTER_TILE_SIZE),
+        (int)((height + FILTER_TILE_SIZE - 1) / FILTER_TILE_SIZE),
+        1
+    };
+}
+
+static void addFilterStage(VulkanPipelineStages* stages, const char* shaderFilename, ivec3 dispatch, std::vector<uint32_t> constants) {
+    // Stages added without constants before the first filter stage get an empty specialization
+    stages->specializationConstants.resize(stages->shaders.size());
+    stages->shaders.push_back(shaderFilename);
+    stages->dispatches.push_back(dispatch);
+    stages->specializationConstants.push_back(constants);
+}
+
+void addSeparableFilterStages(VulkanPipelineStages* stages, ImageFilter filter, uint32_t radius, float sigma, uint32_t width, uint32_t height, bool readFromSecond) {
+    if (radius == 0 || radius > FILTER_MAX_RADIUS) {
+        throw std::runtime_error("filter radius must be between 1 and 16");
+    }
+
+    uint32_t sigmaBits;
+    memcpy(&sigmaBits, &sigma, sizeof(sigmaBits));
+
+    // The horizontal pass writes into the other image and the vertical pass writes back
+    for (uint32_t direction = 0; direction < 2; ++direction) {
+        bool fromSecond = direction == 0 ? readFromSecond : !readFromSecond;
+        std::vector<uint32_t> constants = {radius, direction, fromSecond ? 1u : 0u, (uint32_t)filter, sigmaBits};
+        addFilterStage(stages, "../shaders/filter_separable.spv", getFilterDispatch(width, height), constants);
+    }
+}
+
+void addSobelStage(VulkanPipelineStages* stages, uint32_t width, uint32_t height, bool readFromSecond) {
+    std::vector<uint32_t> constants = {1, 0, readFromSecond ? 1u : 0u};
+    addFilterStage(stages, "../shaders/sobel.spv", getFilterDispatch(width, height), constants);
+}
@@ -0,0 +1,164 @@
+#include "vulkan/vulkan_core.h"
+#include "vulkan_base.h"
+#include <iostream>
+#include <stdexcept>
+
+// Two batches are kept in flight, so the queue keeps working on one while the status of the other is read
+#define ITERATIVE_RUN_SLOTS 2
+
+static void recordTransferBarrier(VkCommandBuffer commandBuffer, VkAccessFlags srcAccess, VkAccessFlags dstAccess, VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage) {
+    VkMemoryBarrier barrier = {VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+    barrier.srcAccessMask = srcAccess;
+    barrier.dstAccessMask = dstAccess;
+    vkCmdPipelineBarrier(
+        commandBuffer,
+        srcStage,
+        dstStage,
+        0,
+        1, &barrier,
+        0, nullptr,
+        0, nullptr
+    );
+}
+
+static void recordIterationBatch(
+    VkCommandBuffer commandBuffer,
+    VulkanPipeline* pipeline, VulkanPipeline* convergencePipeline, VulkanDescriptorSet* descriptorSet,
+    VulkanBuffer* statusBuffer, VulkanBuffer* readbackBuffer, uint32_t slot, uint32_t iterations
+) {
+    VkCommandBufferBeginInfo beginInfo = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+    for (uint32_t i = 0; i < iterations; ++i) {
+        bool checked = i == iterations - 1;
+        if (checked) {
+            // The previous batch may still be copying the status word out, so the fill must not overtake that copy
+            recordTransferBarrier(
+                commandBuffer,
+                0, 0,
+                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT
+            );
+            // The check stage counts unconverged elements into the freshly cleared status word
+            vkCmdFillBuffer(commandBuffer, statusBuffer->buffer, 0, sizeof(uint32_t), 0);
+            recordTransferBarrier(
+                commandBuffer,
+                VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT
+            );
+        }
+
+        recordPipeline(commandBuffer, pipeline, descriptorSet);
+        if (checked && convergencePipeline) {
+            recordPipeline(commandBuffer, convergencePipeline, descriptorSet);
+        }
+    }
+
+    recordTransferBarrier(
+        commandBuffer,
+        VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT
+    );
+    VkBufferCopy copyRegion = {0, slot * sizeof(uint32_t), sizeof(uint32_t)};
+    vkCmdCopyBuffer(commandBuffer, statusBuffer->buffer, readbackBuffer->buffer, 1, &copyRegion);
+    recordTransferBarrier(
+        commandBuffer,
+        VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT
+    );
+
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to record iteration batch!");
+    }
+}
+
+uint32_t runUntilConverged(
+    VulkanContext* context,
+    VulkanPipeline* pipeline, VulkanPipeline* convergencePipeline, VulkanDescriptorSet* descriptorSet,
+    VulkanBuffer* statusBuffer, uint32_t maxIterations, uint32_t checkInterval, bool* converged
+) {
+    if (checkInterval == 0) {
+        throw std::runtime_error("checkInterval must be at least 1");
+    }
+
+    VulkanBuffer readbackBuffer;
+    createReadbackBuffer(context, &readbackBuffer, ITERATIVE_RUN_SLOTS * sizeof(uint32_t));
+    uint32_t* status;
+    vkMapMemory(context->device, readbackBuffer.memory, 0, VK_WHOLE_SIZE, 0, (void**)&status);
+
+    VkCommandBuffer commandBuffers[ITERATIVE_RUN_SLOTS];
+    {
+        VkCommandBufferAllocateInfo allocInfo = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandPool = getThreadCommandPool(context);
+        allocInfo.commandBufferCount = ITERATIVE_RUN_SLOTS;
+        if (vkAllocateCommandBuffers(context->device, &allocInfo, commandBuffers) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate command buffers");
+        }
+    }
+    VkFence fences[ITERATIVE_RUN_SLOTS];
+    for (uint32_t i = 0; i < ITERATIVE_RUN_SLOTS; ++i) {
+        VkFenceCreateInfo createInfo = {VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
+        vkCreateFence(context->device, &createInfo, 0, &fences[i]);
+    }
+
+    bool pending[ITERATIVE_RUN_SLOTS] = {};
+    uint32_t batchEnd[ITERATIVE_RUN_SLOTS] = {};
+    uint32_t iteration = 0;
+    uint32_t batch = 0;
+    *converged = false;
+
+    // Waits for the batch in slot and reports whether its status word says every element converged
+    auto finishBatch = [&](uint32_t slot) {
+        vkWaitForFences(context->device, 1, &fences[slot], VK_TRUE, UINT64_MAX);
+        vkResetFences(context->device, 1, &fences[slot]);
+        pending[slot] = false;
+
+        invalidateMappedBuffer(context, &readbackBuffer);
+        if (status[slot] == 0) {
+            LOG("Converged after " << batchEnd[slot] << " iterations");
+            return true;
+        }
+        return false;
+    };
+
+    while (true) {
+        uint32_t slot = batch % ITERATIVE_RUN_SLOTS;
+        if (pending[slot] && finishBatch(slot)) {
+            *converged = true;
+            break;
+        }
+        if (iteration >= maxIterations) {
+            for (uint32_t i = 0; i < ITERATIVE_RUN_SLOTS; ++i) {
+                if (pending[i] && finishBatch(i)) {
+                    *converged = true;
+                }
+            }
+            break;
+        }
+
+        uint32_t iterations = maxIterations - iteration < checkInterval ? maxIterations - iteration : checkInterval;
+        vkResetCommandBuffer(commandBuffers[slot], 0);
+        recordIterationBatch(commandBuffers[slot], pipeline, convergencePipeline, descriptorSet, statusBuffer, &readbackBuffer, slot, iterations);
+
+        submitCommandBuffers(context, 1, &commandBuffers[slot], fences[slot]);
+
+        pending[slot] = true;
+        iteration += iterations;
+        batchEnd[slot] = iteration;
+        ++batch;
+    }
+
+    // The batch submitted after the converged one has to finish before its resources are released
+    for (uint32_t i = 0; i < ITERATIVE_RUN_SLOTS; ++i) {
+        if (pending[i]) {
+            vkWaitForFences(context->device, 1, &fences[i], VK_TRUE, UINT64_MAX);
+        }
+        vkDestroyFence(context->device, fences[i], 0);
+    }
+    vkFreeCommandBuffers(context->device, getThreadCommandPool(context), ITERATIVE_RUN_SLOTS, commandBuffers);
+    vkUnmapMemory(context->device, readbackBuffer.memory);
+    destroyBuffer(context, &readbackBuffer);
+
+    return iteration;
+}
@@ -0,0 +1,255 @@
+#include "vulkan/vulkan_core.h"
+#include "vulkan_base.h"
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+// Without VK_EXT_memory_budget only this share of a heap is assumed to be available to the application
+#define FALLBACK_BUDGET_PERCENT 80
+
+void initMemoryTracker(VulkanContext* context) {
+    VulkanMemoryTracker* tracker = &context->memoryTracker;
+    vkGetPhysicalDeviceMemoryProperties(context->physicalDevice, &tracker->properties);
+    memset(&tracker->statistics, 0, sizeof(tracker->statistics));
+    tracker->allocations.clear();
+    tracker->policy = MemoryBudgetPolicy::IGNORE;
+    tracker->evictionCallback = nullptr;
+    tracker->evictionUserData = nullptr;
+}
+
+void getMemoryBudget(VulkanContext* context, VulkanMemoryBudget* budget) {
+    VulkanMemoryTracker* tracker = &context->memoryTracker;
+    budget->heapCount = tracker->properties.memoryHeapCount;
+
+    if (tracker->budgetExtensionEnabled) {
+        VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT};
+        VkPhysicalDeviceMemoryProperties2 properties2 = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2};
+        properties2.pNext = &budgetProperties;
+        vkGetPhysicalDeviceMemoryProperties2(context->physicalDevice, &properties2);
+        for (uint32_t i = 0; i < budget->heapCount; ++i) {
+            budget->heapBudget[i] = budgetProperties.heapBudget[i];
+            budget->heapUsage[i] = budgetProperties.heapUsage[i];
+        }
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(tracker->mutex);
+    for (uint32_t i = 0; i < budget->heapCount; ++i) {
+        budget->heapBudget[i] = tracker->properties.memoryHeaps[i].size / 100 * FALLBACK_BUDGET_PERCENT;
+        budget->heapUsage[i] = tracker->statistics.heapLiveBytes[i];
+    }
+}
+
+VkDeviceSize getAvailableMemory(VulkanContext* context, VkMemoryPropertyFlags memoryProperties) {
+    VulkanMemoryTracker* tracker = &context->memoryTracker;
+    VulkanMemoryBudget budget;
+    getMemoryBudget(context, &budget);
+
+    for (uint32_t i = 0; i < tracker->properties.memoryTypeCount; ++i) {
+        if ((tracker->properties.memoryTypes[i].propertyFlags & memoryProperties) == memoryProperties) {
+            uint32_t heapIndex = tracker->properties.memoryTypes[i].heapIndex;
+            return budget.heapUsage[heapIndex] < budget.heapBudget[heapIndex] ? budget.heapBudget[heapIndex] - budget.heapUsage[heapIndex] : 0;
+        }
+    }
+    return 0;
+}
+
+void setMemoryBudgetPolicy(VulkanContext* context, MemoryBudgetPolicy policy, MemoryEvictionCallback evictionCallback, void* userData) {
+    if (policy == MemoryBudgetPolicy::EVICT && evictionCallback == nullptr) {
+        throw std::runtime_error("the EVICT memory budget policy needs an eviction callback");
+    }
+    std::lock_guard<std::mutex> lock(context->memoryTracker.mutex);
+    context->memoryTracker.policy = policy;
+    context->memoryTracker.evictionCallback = evictionCallback;
+    context->memoryTracker.evictionUserData = userData;
+}
+
+static bool fitsMemoryBudget(VulkanContext* context, uint32_t memoryTypeIndex, VkDeviceSize size) {
+    VulkanMemoryBudget budget;
+    getMemoryBudget(context, &budget);
+    uint32_t heapIndex = context->memoryTracker.properties.memoryTypes[memoryTypeIndex].heapIndex;
+    return budget.heapUsage[heapIndex] + size <= budget.heapBudget[heapIndex];
+}
+
+// The tracker lock is not held while the eviction callback runs, as it frees memory itself.
+// Only counts as progress when the heap shrank, so callers retrying in a loop stop once nothing is freed in it
+static bool evictMemory(VulkanContext* context, uint32_t memoryTypeIndex, VkDeviceSize size) {
+    VulkanMemoryTracker* tracker = &context->memoryTracker;
+    uint32_t heapIndex = tracker->properties.memoryTypes[memoryTypeIndex].heapIndex;
+    MemoryEvictionCallback evictionCallback;
+    void* evictionUserData;
+    VkDeviceSize liveBytes;
+    {
+        std::lock_guard<std::mutex> lock(tracker->mutex);
+        evictionCallback = tracker->evictionCallback;
+        evictionUserData = tracker->evictionUserData;
+        liveBytes = tracker->statistics.heapLiveBytes[heapIndex];
+    }
+    if (evictionCallback == nullptr || !evictionCallback(context, heapIndex, size, evictionUserData)) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(tracker->mutex);
+    tracker->statistics.evictions++;
+    if (tracker->statistics.heapLiveBytes[heapIndex] >= liveBytes) {
+        LOG_WARN("eviction callback freed nothing in heap " << heapIndex);
+        return false;
+    }
+    return true;
+}
+
+static MemoryBudgetPolicy getMemoryBudgetPolicy(VulkanContext* context) {
+    std::lock_guard<std::mutex> lock(context->memoryTracker.mutex);
+    return context->memoryTracker.policy;
+}
+
+// A host visible type without DEVICE_LOCAL that the device reads over the bus instead, or UINT32_MAX
+static uint32_t findHostFallbackType(VulkanContext* context, VkMemoryRequirements requirements, VkMemoryPropertyFlags memoryProperties, bool checkBudget) {
+    VulkanMemoryTracker* tracker = &context->memoryTracker;
+    if (!(memoryProperties & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)) {
+        return UINT32_MAX;
+    }
+    VkMemoryPropertyFlags hostProperties = (memoryProperties & ~VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+    for (uint32_t i = 0; i < tracker->properties.memoryTypeCount; ++i) {
+        VkMemoryPropertyFlags flags = tracker->properties.memoryTypes[i].propertyFlags;
+        if ((requirements.memoryTypeBits & (1 << i)) && (flags & hostProperties) == hostProperties &&
+            !(flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) && (!checkBudget || fitsMemoryBudget(context, i, requirements.size))) {
+            std::lock_guard<std::mutex> lock(tracker->mutex);
+            tracker->statistics.hostFallbacks++;
+            return i;
+        }
+    }
+    return UINT32_MAX;
+}
+
+static uint32_t selectMemoryType(VulkanContext* context, VkMemoryRequirements requirements, VkMemoryPropertyFlags memoryProperties, MemoryBudgetPolicy policy) {
+    uint32_t memoryTypeIndex = findMemoryType(context, requirements.memoryTypeBits, memoryProperties);
+    if (policy == MemoryBudgetPolicy::IGNORE || fitsMemoryBudget(context, memoryTypeIndex, requirements.size)) {
+        return memoryTypeIndex;
+    }
+
+    switch (policy) {
+        case MemoryBudgetPolicy::FAIL:
+            throw std::runtime_error("allocation would exceed the memory budget of its heap");
+        case MemoryBudgetPolicy::EVICT:
+            while (!fitsMemoryBudget(context, memoryTypeIndex, requirements.size) && evictMemory(context, memoryTypeIndex, requirements.size)) {
+            }
+            break;
+        case MemoryBudgetPolicy::HOST_FALLBACK: {
+            // The device then reads the data over the bus from host memory, which is slower but keeps the job running
+            uint32_t hostTypeIndex = findHostFallbackType(context, requirements, memoryProperties, true);
+            if (hostTypeIndex != UINT32_MAX) {
+                return hostTypeIndex;
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    return memoryTypeIndex;
+}
+
+VkDeviceMemory allocateMemory(VulkanContext* context, VkMemoryRequirements requirements, VkMemoryPropertyFlags memoryProperties, bool staging, const void* pNext) {
+    VulkanMemoryTracker* tracker = &context->memoryTracker;
+    MemoryBudgetPolicy policy = getMemoryBudgetPolicy(context);
+
+    VkMemoryAllocateInfo allocateInfo = {VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO};
+    allocateInfo.pNext = pNext;
+    allocateInfo.allocationSize = requirements.size;
+    allocateInfo.memoryTypeIndex = selectMemoryType(context, requirements, memoryProperties, policy);
+
+    VkDeviceMemory memory;
+    VkResult result = vkAllocateMemory(context->device, &allocateInfo, 0, &memory);
+    while (result == VK_ERROR_OUT_OF_DEVICE_MEMORY && policy == MemoryBudgetPolicy::EVICT &&
+           evictMemory(context, allocateInfo.memoryTypeIndex, requirements.size)) {
+        result = vkAllocateMemory(context->device, &allocateInfo, 0, &memory);
+    }
+    // The budget is only an estimate, a device that still runs out of memory streams from host memory as well
+    if (result == VK_ERROR_OUT_OF_DEVICE_MEMORY && policy == MemoryBudgetPolicy::HOST_FALLBACK &&
+        (tracker->properties.memoryTypes[allocateInfo.memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)) {
+        uint32_t hostTypeIndex = findHostFallbackType(context, requirements, memoryProperties, false);
+        if (hostTypeIndex != UINT32_MAX) {
+            allocateInfo.memoryTypeIndex = hostTypeIndex;
+            result = vkAllocateMemory(context->device, &allocateInfo, 0, &memory);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(tracker->mutex);
+    VulkanMemoryStatistics& statistics = tracker->statistics;
+    if (result != VK_SUCCESS) {
+        statistics.failedAllocations++;
+        throw std::runtime_error("failed to allocate device memory!");
+    }
+
+    uint32_t typeIndex = allocateInfo.memoryTypeIndex;
+    uint32_t heapIndex = tracker->properties.memoryTypes[typeIndex].heapIndex;
+    tracker->allocations[memory] = {requirements.size, typeIndex};
+
+    statistics.typeLiveBytes[typeIndex] += requirements.size;
+    statistics.typeLiveAllocations[typeIndex]++;
+    statistics.typeTotalAllocations[typeIndex]++;
+    if (statistics.typeLiveBytes[typeIndex] > statistics.typePeakBytes[typeIndex]) {
+        statistics.typePeakBytes[typeIndex] = statistics.typeLiveBytes[typeIndex];
+    }
+    statistics.heapLiveBytes[heapIndex] += requirements.size;
+    if (statistics.heapLiveBytes[heapIndex] > statistics.heapPeakBytes[heapIndex]) {
+        statistics.heapPeakBytes[heapIndex] = statistics.heapLiveBytes[heapIndex];
+    }
+    if (staging) {
+        statistics.stagingAllocations++;
+        statistics.stagingBytes += requirements.size;
+    }
+
+    return memory;
+}
+
+void freeMemory(VulkanContext* context, VkDeviceMemory memory) {
+    if (memory == VK_NULL_HANDLE) {
+        return;
+    }
+    VulkanMemoryTracker* tracker = &context->memoryTracker;
+    {
+        std::lock_guard<std::mutex> lock(tracker->mutex);
+        auto it = tracker->allocations.find(memory);
+        if (it != tracker->allocations.end()) {
+            uint32_t typeIndex = it->second.memoryTypeIndex;
+            uint32_t heapIndex = tracker->properties.memoryTypes[typeIndex].heapIndex;
+            tracker->statistics.typeLiveBytes[typeIndex] -= it->second.size;
+            tracker->statistics.typeLiveAllocations[typeIndex]--;
+            tracker->statistics.heapLiveBytes[heapIndex] -= it->second.size;
+            tracker->allocations.erase(it);
+        }
+    }
+    vkFreeMemory(context->device, memory, 0);
+}
+
+void getMemoryStatistics(VulkanContext* context, VulkanMemoryStatistics* statistics) {
+    std::lock_guard<std::mutex> lock(context->memoryTracker.mutex);
+    *statistics = context->memoryTracker.statistics;
+}
+
+void printMemoryStatistics(VulkanContext* context) {
+    VulkanMemoryTracker* tracker = &context->memoryTracker;
+    VulkanMemoryStatistics statistics;
+    getMemoryStatistics(context, &statistics);
+    VulkanMemoryBudget budget;
+    getMemoryBudget(context, &budget);
+
+    for (uint32_t i = 0; i < tracker->properties.memoryHeapCount; ++i) {
+        LOG("Heap " << i << (tracker->properties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT ? " (device local)" : "")
+            << ": live " << statistics.heapLiveBytes[i] << " B, peak " << statistics.heapPeakBytes[i]
+            << " B, usage " << budget.heapUsage[i] << " / budget " << budget.heapBudget[i] << " B");
+    }
+    for (uint32_t i = 0; i < tracker->properties.memoryTypeCount; ++i) {
+        if (statistics.typeTotalAllocations[i] == 0) {
+            continue;
+        }
+        LOG("  Type " << i << " (heap " << tracker->properties.memoryTypes[i].heapIndex << ", flags " << tracker->properties.memoryTypes[i].propertyFlags
+            << "): live " << statistics.typeLiveBytes[i] << " B in " << statistics.typeLiveAllocations[i]
+            << " allocations, peak " << statistics.typePeakBytes[i] << " B, " << statistics.typeTotalAllocations[i] << " allocations in total");
+    }
+    LOG("Staging: " << statistics.stagingAllocations << " allocations, " << statistics.stagingBytes << " B in total");
+    if (statistics.failedAllocations > 0 || statistics.evictions > 0 || statistics.hostFallbacks > 0) {
+        LOG_WARN(statistics.failedAllocations << " failed allocations, " << statistics.evictions << " evictions, "
+            << statistics.hostFallbacks << " allocations moved to host memory");
+    }
+}
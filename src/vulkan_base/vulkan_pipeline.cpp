@@ -2,9 +2,21 @@
 #include "vulkan_base.h"
 #include <iostream>
 #include <cassert>
+#include <stdexcept>
 
-VkShaderModule createShaderModule(VulkanContext* context, const char* shaderFilename) {
-    VkShaderModule result;
+VkShaderModule createShaderModuleFromCode(VulkanContext* context, const uint32_t* code, size_t size) {
+    VkShaderModule result = VK_NULL_HANDLE;
+
+    VkShaderModuleCreateInfo createInfo = {VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO};
+    createInfo.codeSize = size;
+    createInfo.pCode = code;
+    vkCreateShaderModule(context->device, &createInfo, 0, &result);
+
+    return result;
+}
+
+VkShaderModule createShaderModuleFromFile(VulkanContext* context, const char* shaderFilename) {
+    VkShaderModule result = VK_NULL_HANDLE;
 
     FILE* file = fopen(shaderFilename, "rb");
     if(!file) {
@@ -15,13 +27,10 @@ VkShaderModule createShaderModule(VulkanContext* context, const char* shaderFile
     long fileSize = ftell(file);
     fseek(file, 0, SEEK_SET);
     assert((fileSize & 0x03) == 0);
-    uint8_t* buffer = new uint8_t[fileSize];
+    uint32_t* buffer = new uint32_t[fileSize / sizeof(uint32_t)];
     fread(buffer, 1, fileSize, file);
 
-    VkShaderModuleCreateInfo createInfo = {VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO};
-    createInfo.codeSize = fileSize;
-    createInfo.pCode = (uint32_t*)buffer;
-    vkCreateShaderModule(context->device, &createInfo, 0, &result);
+    result = createShaderModuleFromCode(context, buffer, fileSize);
 
     delete[] buffer;
     fclose(file);
@@ -29,29 +38,60 @@ VkShaderModule createShaderModule(VulkanContext* context, const char* shaderFile
     return result;
 }
 
+VkShaderModule createShaderModule(VulkanContext* context, const char* shaderFilename) {
+    const VulkanEmbeddedShader* embeddedShader = findEmbeddedShader(shaderFilename);
+    if (embeddedShader) {
+        return createShaderModuleFromCode(context, embeddedShader->code, embeddedShader->size);
+    }
+    return createShaderModuleFromFile(context, shaderFilename);
+}
 
+static VulkanPipeline createPipelineWithLayout(VulkanContext* context, std::vector<const char*> computeShaderFilenames, std::vector<ivec3> dispatches, VkDescriptorSetLayout descriptorSetLayout, uint32_t pushConstantSize, std::vector<std::vector<uint32_t>> specializationConstants) {
+    if (!specializationConstants.empty() && specializationConstants.size() != computeShaderFilenames.size()) {
+        throw std::runtime_error("specialization constants must be given for every shader or for none");
+    }
 
-VulkanPipeline createPipeline(VulkanContext* context, std::vector<const char*> computeShaderFilenames, std::vector<ivec3> dispatches, VulkanDescriptorSet* descriptorSet) {
     VkPipelineLayout pipelineLayout;
     {
+        VkPushConstantRange pushConstantRange = {};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = pushConstantSize;
+
         VkPipelineLayoutCreateInfo createInfo = {VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
         createInfo.setLayoutCount = 1;
-        createInfo.pSetLayouts = &descriptorSet->descriptorSetLayout;
+        createInfo.pSetLayouts = &descriptorSetLayout;
+        createInfo.pushConstantRangeCount = pushConstantSize > 0 ? 1 : 0;
+        createInfo.pPushConstantRanges = &pushConstantRange;
         vkCreatePipelineLayout(context->device, &createInfo, 0, &pipelineLayout);
     }
 
     
     std::vector<VkPipeline> pipelines;
-    for (auto fileName : computeShaderFilenames) {
+    for (size_t i = 0; i < computeShaderFilenames.size(); ++i) {
         VkPipeline pipeline;
 
         {
-            VkShaderModule computeShaderModule = createShaderModule(context, fileName);
+            VkShaderModule computeShaderModule = createShaderModule(context, computeShaderFilenames[i]);
+
+            // Constant i of a shader is read from constant_id = i
+            std::vector<VkSpecializationMapEntry> mapEntries;
+            VkSpecializationInfo specializationInfo = {};
+            if (!specializationConstants.empty()) {
+                for (uint32_t id = 0; id < specializationConstants[i].size(); ++id) {
+                    mapEntries.push_back({id, id * (uint32_t)sizeof(uint32_t), sizeof(uint32_t)});
+                }
+                specializationInfo.mapEntryCount = static_cast<uint32_t>(mapEntries.size());
+                specializationInfo.pMapEntries = mapEntries.data();
+                specializationInfo.dataSize = specializationConstants[i].size() * sizeof(uint32_t);
+                specializationInfo.pData = specializationConstants[i].data();
+            }
         
             VkPipelineShaderStageCreateInfo shaderStage = {VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO};
             shaderStage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
             shaderStage.module = computeShaderModule;
             shaderStage.pName = "main";
+            shaderStage.pSpecializationInfo = mapEntries.empty() ? nullptr : &specializationInfo;
 
             VkComputePipelineCreateInfo createInfo = {VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO};
             createInfo.layout = pipelineLayout;
@@ -67,10 +107,129 @@ VulkanPipeline createPipeline(VulkanContext* context, std::vector<const char*> c
     result.pipelines = pipelines;
     result.pipelineLayout = pipelineLayout;
     result.dispatchSizes = dispatches;
+    result.indirectBuffers = std::vector<VkBuffer>(pipelines.size(), VK_NULL_HANDLE);
+    result.indirectOffsets = std::vector<VkDeviceSize>(pipelines.size(), 0);
+    result.pushConstantSize = pushConstantSize;
 
     return result;
 }
 
+VulkanPipeline createPipeline(VulkanContext* context, std::vector<const char*> computeShaderFilenames, std::vector<ivec3> dispatches, VulkanDescriptorSet* descriptorSet, uint32_t pushConstantSize, std::vector<std::vector<uint32_t>> specializationConstants) {
+    return createPipelineWithLayout(context, computeShaderFilenames, dispatches, descriptorSet->descriptorSetLayout, pushConstantSize, specializationConstants);
+}
+
+VulkanPipeline createBindlessPipeline(VulkanContext* context, std::vector<const char*> computeShaderFilenames, std::vector<ivec3> dispatches, VulkanBindlessSet* bindlessSet, uint32_t pushConstantSize, std::vector<std::vector<uint32_t>> specializationConstants) {
+    return createPipelineWithLayout(context, computeShaderFilenames, dispatches, bindlessSet->descriptorSetLayout, pushConstantSize, specializationConstants);
+}
+
+void setIndirectDispatch(VulkanPipeline* pipeline, uint32_t stage, VulkanBuffer* buffer, VkDeviceSize offset) {
+    if (stage >= pipeline->pipelines.size()) {
+        throw std::runtime_error("indirect dispatch set for a stage that does not exist");
+    }
+    if (offset % 4 != 0) {
+        throw std::runtime_error("indirect dispatch offset must be a multiple of 4");
+    }
+    pipeline->indirectBuffers[stage] = buffer ? buffer->buffer : VK_NULL_HANDLE;
+    pipeline->indirectOffsets[stage] = offset;
+}
+
+static void dispatchStage(VkCommandBuffer commandBuffer, VulkanPipeline* pipeline, size_t i) {
+    if (pipeline->indirectBuffers[i] != VK_NULL_HANDLE) {
+        vkCmdDispatchIndirect(commandBuffer, pipeline->indirectBuffers[i], pipeline->indirectOffsets[i]);
+    } else {
+        ivec3 dispatchSize = pipeline->dispatchSizes[i];
+        vkCmdDispatch(commandBuffer, dispatchSize.x, dispatchSize.y, dispatchSize.z);
+    }
+}
+
+// Later stages may read the results as data or as their indirect dispatch arguments
+static void recordStageBarrier(VkCommandBuffer commandBuffer) {
+    VkMemoryBarrier barrier = {VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+    vkCmdPipelineBarrier(
+        commandBuffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+        0,
+        1, &barrier,
+        0, nullptr,
+        0, nullptr
+    );
+}
+
+static void recordStageDispatch(VkCommandBuffer commandBuffer, VulkanPipeline* pipeline, size_t i) {
+    dispatchStage(commandBuffer, pipeline, i);
+    recordStageBarrier(commandBuffer);
+}
+
+void recordPipeline(VkCommandBuffer commandBuffer, VulkanPipeline* pipeline, VulkanDescriptorSet* descriptorSet) {
+    vkCmdBindDescriptorSets(
+        commandBuffer, 
+        VK_PIPELINE_BIND_POINT_COMPUTE, 
+        pipeline->pipelineLayout, 
+        0, 
+        1, 
+        &descriptorSet->descriptorSet, 
+        0, 
+        0
+    );
+
+    for (size_t i = 0; i < pipeline->pipelines.size(); ++i) {
+        vkCmdBindPipeline(
+            commandBuffer, 
+            VK_PIPELINE_BIND_POINT_COMPUTE, 
+            pipeline->pipelines[i]
+        );
+
+        recordStageDispatch(commandBuffer, pipeline, i);
+    }
+}
+
+void recordPipelineBatch(VkCommandBuffer commandBuffer, VulkanPipeline* pipeline, uint32_t setCount, const VkDescriptorSet* descriptorSets, const void* const* pushConstants) {
+    for (size_t i = 0; i < pipeline->pipelines.size(); ++i) {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline->pipelines[i]);
+        for (uint32_t set = 0; set < setCount; ++set) {
+            vkCmdBindDescriptorSets(
+                commandBuffer,
+                VK_PIPELINE_BIND_POINT_COMPUTE,
+                pipeline->pipelineLayout,
+                0,
+                1,
+                &descriptorSets[set],
+                0,
+                0
+            );
+            if (pipeline->pushConstantSize > 0) {
+                vkCmdPushConstants(commandBuffer, pipeline->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, pipeline->pushConstantSize, pushConstants[set]);
+            }
+            dispatchStage(commandBuffer, pipeline, i);
+        }
+        recordStageBarrier(commandBuffer);
+    }
+}
+
+void recordBindlessStage(VkCommandBuffer commandBuffer, VulkanPipeline* pipeline, uint32_t stage, VulkanBindlessSet* bindlessSet, const void* pushConstants) {
+    if (stage >= pipeline->pipelines.size()) {
+        throw std::runtime_error("recorded a stage that does not exist");
+    }
+    vkCmdBindDescriptorSets(
+        commandBuffer,
+        VK_PIPELINE_BIND_POINT_COMPUTE,
+        pipeline->pipelineLayout,
+        0,
+        1,
+        &bindlessSet->descriptorSet,
+        0,
+        0
+    );
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline->pipelines[stage]);
+    if (pipeline->pushConstantSize > 0) {
+        vkCmdPushConstants(commandBuffer, pipeline->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, pipeline->pushConstantSize, pushConstants);
+    }
+    recordStageDispatch(commandBuffer, pipeline, stage);
+}
+
 void destroyPipeline(VulkanContext* context, VulkanPipeline* pipeline) {
     for(auto vkPipeline : pipeline->pipelines){
         vkDestroyPipeline(context->device, vkPipeline, 0);
@@ -0,0 +1,273 @@
+#include "vulkan/vulkan_core.h"
+#include "vulkan_base.h"
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PACK_SIMD_SSE2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define PACK_SIMD_NEON 1
+#endif
+
+// Elements per SIMD step, the scalar conversions handle the rest
+#define PACK_SIMD_WIDTH 8
+
+static uint32_t floatBits(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static float bitsToFloat(uint32_t bits) {
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Rounds to nearest even like the hardware conversions. Values beyond the half range become infinity, NaNs stay NaNs
+static uint16_t floatToHalf(float value) {
+    uint32_t bits = floatBits(value);
+    uint32_t sign = bits & 0x80000000u;
+    bits ^= sign;
+
+    uint32_t half;
+    if (bits >= (127u + 16u) << 23) {
+        half = bits > 0x7f800000u ? 0x7e00 : 0x7c00;
+    } else if (bits < (127u - 14u) << 23) {
+        // Adding the magic number shifts the subnormal mantissa into place and rounds it
+        uint32_t magic = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+        half = floatBits(bitsToFloat(bits) + bitsToFloat(magic)) - magic;
+    } else {
+        uint32_t mantissaOdd = (bits >> 13) & 1;
+        bits += ((uint32_t)(15 - 127) << 23) + 0xfff + mantissaOdd;
+        half = bits >> 13;
+    }
+    return static_cast<uint16_t>(half | (sign >> 16));
+}
+
+static float halfToFloat(uint16_t half) {
+    uint32_t exponentMantissa = half & 0x7fffu;
+    // Scaling by 2^(127 - 15) rebiases the exponent and normalizes subnormals
+    uint32_t bits = floatBits(bitsToFloat(exponentMantissa << 13) * bitsToFloat((254u - 15u) << 23));
+    if (exponentMantissa > 0x7bffu) {
+        bits |= 255u << 23;
+    }
+    return bitsToFloat(bits | ((uint32_t)(half & 0x8000u) << 16));
+}
+
+// Clamps like the SIMD min/max below, which turn NaN into the lower bound
+static float clampUnit(float value, float low) {
+    value = value > low ? value : low;
+    return value < 1.0f ? value : 1.0f;
+}
+
+#if PACK_SIMD_SSE2
+// The SSE2 versions of floatToHalf and halfToFloat, for four values in the low 16 bits of every lane
+static __m128i floatToHalf4(__m128 value) {
+    __m128 sign = _mm_and_ps(value, _mm_castsi128_ps(_mm_set1_epi32((int)0x80000000u)));
+    __m128 absolute = _mm_xor_ps(value, sign);
+    __m128i bits = _mm_castps_si128(absolute);
+
+    __m128i isNan = _mm_castps_si128(_mm_cmpunord_ps(absolute, absolute));
+    __m128i isRegular = _mm_cmpgt_epi32(_mm_set1_epi32((127 + 16) << 23), bits);
+    __m128i infinityOrNan = _mm_or_si128(_mm_and_si128(isNan, _mm_set1_epi32(0x200)), _mm_set1_epi32(0x7c00));
+
+    __m128i isSubnormal = _mm_cmpgt_epi32(_mm_set1_epi32((127 - 14) << 23), bits);
+    __m128i magic = _mm_set1_epi32(((127 - 15) + (23 - 10) + 1) << 23);
+    __m128i subnormal = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(absolute, _mm_castsi128_ps(magic))), magic);
+
+    __m128i mantissaOdd = _mm_srai_epi32(_mm_slli_epi32(bits, 31 - 13), 31);
+    __m128i rounded = _mm_sub_epi32(_mm_add_epi32(bits, _mm_set1_epi32((int)(0xfffu + ((uint32_t)(15 - 127) << 23)))), mantissaOdd);
+    __m128i normal = _mm_srli_epi32(rounded, 13);
+
+    __m128i finite = _mm_or_si128(_mm_and_si128(isSubnormal, subnormal), _mm_andnot_si128(isSubnormal, normal));
+    __m128i half = _mm_or_si128(_mm_and_si128(isRegular, finite), _mm_andnot_si128(isRegular, infinityOrNan));
+    // The sign is shifted in arithmetically, so the lanes stay in int16 range for _mm_packs_epi32
+    return _mm_or_si128(half, _mm_srai_epi32(_mm_castps_si128(sign), 16));
+}
+
+static __m128 halfToFloat4(__m128i half) {
+    __m128i exponentMantissa = _mm_and_si128(half, _mm_set1_epi32(0x7fff));
+    __m128i sign = _mm_slli_epi32(_mm_xor_si128(half, exponentMantissa), 16);
+    __m128 scaled = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(exponentMantissa, 13)), _mm_castsi128_ps(_mm_set1_epi32((254 - 15) << 23)));
+    __m128i isInfinityOrNan = _mm_cmpgt_epi32(exponentMantissa, _mm_set1_epi32(0x7bff));
+    __m128i exponent = _mm_and_si128(isInfinityOrNan, _mm_set1_epi32(255 << 23));
+    return _mm_or_ps(scaled, _mm_castsi128_ps(_mm_or_si128(sign, exponent)));
+}
+#endif
+
+static size_t packHalf(const float* input, uint16_t* output, size_t count) {
+    size_t i = 0;
+#if PACK_SIMD_SSE2
+    for (; i + PACK_SIMD_WIDTH <= count; i += PACK_SIMD_WIDTH) {
+        __m128i low = floatToHalf4(_mm_loadu_ps(input + i));
+        __m128i high = floatToHalf4(_mm_loadu_ps(input + i + 4));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), _mm_packs_epi32(low, high));
+    }
+#elif PACK_SIMD_NEON
+    for (; i + PACK_SIMD_WIDTH <= count; i += PACK_SIMD_WIDTH) {
+        vst1_u16(output + i, vreinterpret_u16_f16(vcvt_f16_f32(vld1q_f32(input + i))));
+        vst1_u16(output + i + 4, vreinterpret_u16_f16(vcvt_f16_f32(vld1q_f32(input + i + 4))));
+    }
+#endif
+    return i;
+}
+
+static size_t unpackHalf(const uint16_t* input, float* output, size_t count) {
+    size_t i = 0;
+#if PACK_SIMD_SSE2
+    __m128i zero = _mm_setzero_si128();
+    for (; i + PACK_SIMD_WIDTH <= count; i += PACK_SIMD_WIDTH) {
+        __m128i half = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+        _mm_storeu_ps(output + i, halfToFloat4(_mm_unpacklo_epi16(half, zero)));
+        _mm_storeu_ps(output + i + 4, halfToFloat4(_mm_unpackhi_epi16(half, zero)));
+    }
+#elif PACK_SIMD_NEON
+    for (; i + PACK_SIMD_WIDTH <= count; i += PACK_SIMD_WIDTH) {
+        vst1q_f32(output + i, vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(input + i))));
+        vst1q_f32(output + i + 4, vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(input + i + 4))));
+    }
+#endif
+    return i;
+}
+
+// Eight floats to eight bytes, snorm scales [-1, 1] by 127 and unorm [0, 1] by 255, both round to nearest even
+static size_t packNorm8(const float* input, uint8_t* output, size_t count, bool isSigned) {
+    size_t i = 0;
+#if PACK_SIMD_SSE2
+    __m128 low = _mm_set1_ps(isSigned ? -1.0f : 0.0f);
+    __m128 high = _mm_set1_ps(1.0f);
+    __m128 scale = _mm_set1_ps(isSigned ? 127.0f : 255.0f);
+    for (; i + PACK_SIMD_WIDTH <= count; i += PACK_SIMD_WIDTH) {
+        __m128i a = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(input + i), low), high), scale));
+        __m128i b = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(input + i + 4), low), high), scale));
+        __m128i words = _mm_packs_epi32(a, b);
+        __m128i bytes = isSigned ? _mm_packs_epi16(words, words) : _mm_packus_epi16(words, words);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(output + i), bytes);
+    }
+#elif PACK_SIMD_NEON
+    float32x4_t low = vdupq_n_f32(isSigned ? -1.0f : 0.0f);
+    float32x4_t high = vdupq_n_f32(1.0f);
+    float scale = isSigned ? 127.0f : 255.0f;
+    for (; i + PACK_SIMD_WIDTH <= count; i += PACK_SIMD_WIDTH) {
+        float32x4_t a = vmulq_n_f32(vminq_f32(vmaxq_f32(vld1q_f32(input + i), low), high), scale);
+        float32x4_t b = vmulq_n_f32(vminq_f32(vmaxq_f32(vld1q_f32(input + i + 4), low), high), scale);
+        if (isSigned) {
+            int16x8_t words = vcombine_s16(vqmovn_s32(vcvtnq_s32_f32(a)), vqmovn_s32(vcvtnq_s32_f32(b)));
+            vst1_s8(reinterpret_cast<int8_t*>(output + i), vqmovn_s16(words));
+        } else {
+            uint16x8_t words = vcombine_u16(vqmovn_u32(vcvtnq_u32_f32(a)), vqmovn_u32(vcvtnq_u32_f32(b)));
+            vst1_u8(output + i, vqmovn_u16(words));
+        }
+    }
+#endif
+    return i;
+}
+
+static size_t unpackNorm8(const uint8_t* input, float* output, size_t count, bool isSigned) {
+    size_t i = 0;
+#if PACK_SIMD_SSE2
+    __m128 scale = _mm_set1_ps(isSigned ? 127.0f : 255.0f);
+    __m128 low = _mm_set1_ps(-1.0f);
+    __m128i zero = _mm_setzero_si128();
+    for (; i + PACK_SIMD_WIDTH <= count; i += PACK_SIMD_WIDTH) {
+        __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(input + i));
+        __m128i a, b;
+        if (isSigned) {
+            // Unpacking a register with itself and shifting arithmetically sign-extends
+            __m128i words = _mm_srai_epi16(_mm_unpacklo_epi8(bytes, bytes), 8);
+            a = _mm_srai_epi32(_mm_unpacklo_epi16(words, words), 16);
+            b = _mm_srai_epi32(_mm_unpackhi_epi16(words, words), 16);
+        } else {
+            __m128i words = _mm_unpacklo_epi8(bytes, zero);
+            a = _mm_unpacklo_epi16(words, zero);
+            b = _mm_unpackhi_epi16(words, zero);
+        }
+        // -128 is the second encoding of -1 in snorm
+        _mm_storeu_ps(output + i, _mm_max_ps(_mm_div_ps(_mm_cvtepi32_ps(a), scale), low));
+        _mm_storeu_ps(output + i + 4, _mm_max_ps(_mm_div_ps(_mm_cvtepi32_ps(b), scale), low));
+    }
+#elif PACK_SIMD_NEON
+    float32x4_t scale = vdupq_n_f32(isSigned ? 127.0f : 255.0f);
+    float32x4_t low = vdupq_n_f32(-1.0f);
+    for (; i + PACK_SIMD_WIDTH <= count; i += PACK_SIMD_WIDTH) {
+        int32x4_t a, b;
+        if (isSigned) {
+            int16x8_t words = vmovl_s8(vld1_s8(reinterpret_cast<const int8_t*>(input + i)));
+            a = vmovl_s16(vget_low_s16(words));
+            b = vmovl_s16(vget_high_s16(words));
+        } else {
+            uint16x8_t words = vmovl_u8(vld1_u8(input + i));
+            a = vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(words)));
+            b = vreinterpretq_s32_u32(vmovl_u16(vget_high_u16(words)));
+        }
+        vst1q_f32(output + i, vmaxq_f32(vdivq_f32(vcvtq_f32_s32(a), scale), low));
+        vst1q_f32(output + i + 4, vmaxq_f32(vdivq_f32(vcvtq_f32_s32(b), scale), low));
+    }
+#endif
+    return i;
+}
+
+size_t getPackedElementSize(PackedFormat format) {
+    return format == PackedFormat::FLOAT16 ? sizeof(uint16_t) : sizeof(uint8_t);
+}
+
+void packFloats(PackedFormat format, const float* input, void* output, size_t count) {
+    switch (format) {
+        case PackedFormat::FLOAT16: {
+            uint16_t* halves = static_cast<uint16_t*>(output);
+            for (size_t i = packHalf(input, halves, count); i < count; ++i) {
+                halves[i] = floatToHalf(input[i]);
+            }
+            break;
+        }
+        case PackedFormat::SNORM8: {
+            int8_t* bytes = static_cast<int8_t*>(output);
+            for (size_t i = packNorm8(input, static_cast<uint8_t*>(output), count, true); i < count; ++i) {
+                bytes[i] = static_cast<int8_t>(lrintf(clampUnit(input[i], -1.0f) * 127.0f));
+            }
+            break;
+        }
+        case PackedFormat::UNORM8: {
+            uint8_t* bytes = static_cast<uint8_t*>(output);
+            for (size_t i = packNorm8(input, bytes, count, false); i < count; ++i) {
+                bytes[i] = static_cast<uint8_t>(lrintf(clampUnit(input[i], 0.0f) * 255.0f));
+            }
+            break;
+        }
+        default:
+            throw std::runtime_error("unknown packed format");
+    }
+}
+
+void unpackFloats(PackedFormat format, const void* input, float* output, size_t count) {
+    switch (format) {
+        case PackedFormat::FLOAT16: {
+            const uint16_t* halves = static_cast<const uint16_t*>(input);
+            for (size_t i = unpackHalf(halves, output, count); i < count; ++i) {
+                output[i] = halfToFloat(halves[i]);
+            }
+            break;
+        }
+        case PackedFormat::SNORM8: {
+            const int8_t* bytes = static_cast<const int8_t*>(input);
+            for (size_t i = unpackNorm8(static_cast<const uint8_t*>(input), output, count, true); i < count; ++i) {
+                float value = bytes[i] / 127.0f;
+                output[i] = value > -1.0f ? value : -1.0f;
+            }
+            break;
+        }
+        case PackedFormat::UNORM8: {
+            const uint8_t* bytes = static_cast<const uint8_t*>(input);
+            for (size_t i = unpackNorm8(bytes, output, count, false); i < count; ++i) {
+                output[i] = bytes[i] / 255.0f;
+            }
+            break;
+        }
+        default:
+            throw std::runtime_error("unknown packed format");
+    }
+}
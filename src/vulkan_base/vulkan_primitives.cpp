@@ -0,0 +1,310 @@
+#include "vulkan/vulkan_core.h"
+#include "vulkan_base.h"
+#include <iostream>
+#include <stdexcept>
+
+#define PRIMITIVE_BINDING_COUNT 5
+#define PRIMITIVE_SETS_PER_POOL 64
+#define PRIMITIVE_MAX_HISTOGRAM_BINS 1024
+#define PRIMITIVE_MAX_GROUPS_X 65535
+
+// Elements handled by one workgroup of the corresponding kernel
+#define REDUCE_BLOCK_SIZE 1024
+#define SCAN_BLOCK_SIZE 256
+#define HISTOGRAM_BLOCK_SIZE 4096
+#define RADIX_BLOCK_SIZE 256
+#define RADIX_DIGITS 16
+
+enum PrimitiveKernel {
+    PRIMITIVE_REDUCE,
+    PRIMITIVE_SCAN_BLOCKS,
+    PRIMITIVE_SCAN_ADD,
+    PRIMITIVE_HISTOGRAM,
+    PRIMITIVE_COMPACT_SCATTER,
+    PRIMITIVE_RADIX_COUNT,
+    PRIMITIVE_RADIX_SCATTER,
+};
+
+struct PrimitivePushConstants {
+    uint32_t count;
+    uint32_t shift;
+    uint32_t flags;
+    uint32_t binCount;
+};
+
+static uint32_t divideRoundingUp(uint32_t value, uint32_t divisor) {
+    return (value + divisor - 1) / divisor;
+}
+
+static void createScratchBuffer(VulkanContext* context, VulkanBuffer* buffer, uint32_t elementCount) {
+    createBuffer(
+        context,
+        buffer,
+        (elementCount > 0 ? elementCount : 1) * sizeof(uint32_t),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+    );
+}
+
+// Unused bindings are pointed at the dummy buffer so every descriptor stays valid
+static VkDescriptorSet allocatePrimitiveSet(VulkanContext* context, VulkanPrimitives* primitives, VulkanBuffer* b0, VulkanBuffer* b1, VulkanBuffer* b2, VulkanBuffer* b3, VulkanBuffer* b4) {
+    VkDescriptorSet descriptorSet = allocateJobDescriptorSet(context, primitives->descriptorAllocator);
+
+    VulkanBuffer* buffers[PRIMITIVE_BINDING_COUNT] = {b0, b1, b2, b3, b4};
+    VulkanDescriptorBufferInfo resources[PRIMITIVE_BINDING_COUNT];
+    for (uint32_t i = 0; i < PRIMITIVE_BINDING_COUNT; ++i) {
+        resources[i] = describeBuffer(buffers[i] ? buffers[i] : &primitives->dummyBuffer);
+    }
+    updateJobDescriptorSet(context, primitives->descriptorAllocator, descriptorSet, resources);
+
+    return descriptorSet;
+}
+
+static void recordPrimitiveBarrier(VkCommandBuffer commandBuffer, VkAccessFlags srcAccess, VkPipelineStageFlags srcStage) {
+    VkMemoryBarrier barrier = {VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+    barrier.srcAccessMask = srcAccess;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(
+        commandBuffer,
+        srcStage,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0,
+        1, &barrier,
+        0, nullptr,
+        0, nullptr
+    );
+}
+
+static void recordPrimitiveDispatch(VkCommandBuffer commandBuffer, VulkanPrimitives* primitives, PrimitiveKernel kernel, VkDescriptorSet descriptorSet, PrimitivePushConstants pushConstants, uint32_t groupCount) {
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, primitives->pipeline.pipelines[kernel]);
+    vkCmdBindDescriptorSets(
+        commandBuffer,
+        VK_PIPELINE_BIND_POINT_COMPUTE,
+        primitives->pipeline.pipelineLayout,
+        0,
+        1,
+        &descriptorSet,
+        0,
+        0
+    );
+    vkCmdPushConstants(commandBuffer, primitives->pipeline.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+
+    // Kernels flatten (x, y) back into a block index, so large inputs spill into the y dimension
+    uint32_t groupsX = groupCount < PRIMITIVE_MAX_GROUPS_X ? groupCount : PRIMITIVE_MAX_GROUPS_X;
+    uint32_t groupsY = divideRoundingUp(groupCount, PRIMITIVE_MAX_GROUPS_X);
+    vkCmdDispatch(commandBuffer, groupsX > 0 ? groupsX : 1, groupsY > 0 ? groupsY : 1, 1);
+
+    recordPrimitiveBarrier(commandBuffer, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+}
+
+// Scans count uints from input into output, recursing over the block sums of each level
+static void recordScan(VulkanContext* context, VulkanPrimitives* primitives, VkCommandBuffer commandBuffer, VulkanBuffer* input, VulkanBuffer* output, uint32_t count, bool inclusive, uint32_t level) {
+    uint32_t blockCount = divideRoundingUp(count, SCAN_BLOCK_SIZE);
+    if (level >= primitives->scanBlockSums.size()) {
+        throw std::runtime_error("scan exceeds the scratch levels of the primitives");
+    }
+    VulkanBuffer* blockSums = &primitives->scanBlockSums[level];
+
+    PrimitivePushConstants pushConstants = {count, 0, inclusive ? 1u : 0u, 0};
+    VkDescriptorSet scanSet = allocatePrimitiveSet(context, primitives, input, output, blockSums, nullptr, nullptr);
+    recordPrimitiveDispatch(commandBuffer, primitives, PRIMITIVE_SCAN_BLOCKS, scanSet, pushConstants, blockCount);
+
+    if (blockCount > 1) {
+        recordScan(context, primitives, commandBuffer, blockSums, blockSums, blockCount, false, level + 1);
+        recordPrimitiveDispatch(commandBuffer, primitives, PRIMITIVE_SCAN_ADD, scanSet, pushConstants, blockCount);
+    }
+}
+
+static void checkPrimitiveCount(VulkanPrimitives* primitives, uint32_t count) {
+    if (count > primitives->maxElements) {
+        throw std::runtime_error("element count exceeds the maxElements the primitives were created with");
+    }
+}
+
+static void submitPrimitiveCommands(VulkanContext* context, VulkanPrimitives* primitives, VkCommandBuffer commandBuffer) {
+    endSingleTimeCommands(context, commandBuffer);
+    resetDescriptorAllocator(context, primitives->descriptorAllocator);
+}
+
+VulkanPrimitives* initPrimitives(VulkanContext* context, uint32_t maxElements) {
+    VulkanPrimitives* primitives = new VulkanPrimitives;
+    primitives->maxElements = maxElements;
+
+    VkPhysicalDeviceSubgroupProperties& subgroupProperties = context->subgroupProperties;
+    primitives->useSubgroups =
+        (subgroupProperties.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT) &&
+        (subgroupProperties.supportedOperations & VK_SUBGROUP_FEATURE_ARITHMETIC_BIT);
+    LOG("Primitives use " << (primitives->useSubgroups ? "subgroup" : "shared memory") << " kernels");
+
+    primitives->descriptorSetInfo = initDescriptorSet();
+    for (uint32_t i = 0; i < PRIMITIVE_BINDING_COUNT; ++i) {
+        addDescriptorSetLayout(primitives->descriptorSetInfo, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    }
+    createDescriptorSetLayout(context, primitives->descriptorSetInfo);
+
+    primitives->descriptorAllocator = createDescriptorAllocator(context, primitives->descriptorSetInfo, PRIMITIVE_SETS_PER_POOL);
+
+    std::vector<const char*> computeShaders;
+    computeShaders.push_back(primitives->useSubgroups ? "../shaders/reduce_subgroup.spv" : "../shaders/reduce_shared.spv");
+    computeShaders.push_back(primitives->useSubgroups ? "../shaders/scan_subgroup.spv" : "../shaders/scan_shared.spv");
+    computeShaders.push_back("../shaders/scan_add.spv");
+    computeShaders.push_back("../shaders/histogram.spv");
+    computeShaders.push_back("../shaders/compact_scatter.spv");
+    computeShaders.push_back("../shaders/radix_count.spv");
+    computeShaders.push_back("../shaders/radix_scatter.spv");
+    // Group counts depend on the input size and are computed per call
+    std::vector<ivec3> dispatches(computeShaders.size(), ivec3{1, 1, 1});
+    primitives->pipeline = createPipeline(context, computeShaders, dispatches, primitives->descriptorSetInfo, sizeof(PrimitivePushConstants));
+
+    // Radix sort scans RADIX_DIGITS counters per block, which can outgrow maxElements for tiny inputs
+    uint32_t maxScanElements = RADIX_DIGITS * divideRoundingUp(maxElements, RADIX_BLOCK_SIZE);
+    if (maxScanElements < maxElements) {
+        maxScanElements = maxElements;
+    }
+    uint32_t levelCount = maxScanElements;
+    do {
+        levelCount = divideRoundingUp(levelCount, SCAN_BLOCK_SIZE);
+        VulkanBuffer blockSums;
+        createScratchBuffer(context, &blockSums, levelCount);
+        primitives->scanBlockSums.push_back(blockSums);
+    } while (levelCount > 1);
+
+    uint32_t reduceBlocks = divideRoundingUp(maxElements, REDUCE_BLOCK_SIZE);
+    createScratchBuffer(context, &primitives->reducePartials[0], reduceBlocks);
+    createScratchBuffer(context, &primitives->reducePartials[1], divideRoundingUp(reduceBlocks, REDUCE_BLOCK_SIZE));
+    createScratchBuffer(context, &primitives->scanOffsets, maxScanElements);
+    createScratchBuffer(context, &primitives->sortKeys, maxElements);
+    createScratchBuffer(context, &primitives->sortValues, maxElements);
+    createScratchBuffer(context, &primitives->dummyBuffer, 4);
+
+    return primitives;
+}
+
+void destroyPrimitives(VulkanContext* context, VulkanPrimitives* primitives) {
+    for (size_t i = 0; i < primitives->scanBlockSums.size(); ++i) {
+        destroyBuffer(context, &primitives->scanBlockSums[i]);
+    }
+    destroyBuffer(context, &primitives->reducePartials[0]);
+    destroyBuffer(context, &primitives->reducePartials[1]);
+    destroyBuffer(context, &primitives->scanOffsets);
+    destroyBuffer(context, &primitives->sortKeys);
+    destroyBuffer(context, &primitives->sortValues);
+    destroyBuffer(context, &primitives->dummyBuffer);
+
+    destroyPipeline(context, &primitives->pipeline);
+    destroyDescriptorSet(context, primitives->descriptorSetInfo);
+    destroyDescriptorAllocator(context, primitives->descriptorAllocator);
+    delete primitives->descriptorSetInfo;
+    delete primitives;
+}
+
+void reduceSum(VulkanContext* context, VulkanPrimitives* primitives, VulkanBuffer* input, VulkanBuffer* output, uint32_t count) {
+    std::lock_guard<std::mutex> lock(primitives->mutex);
+    checkPrimitiveCount(primitives, count);
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands(context);
+
+    if (count == 0) {
+        // No group would run, so the empty sum is written here
+        vkCmdFillBuffer(commandBuffer, output->buffer, 0, sizeof(float), 0);
+        submitPrimitiveCommands(context, primitives, commandBuffer);
+        return;
+    }
+
+    VulkanBuffer* source = input;
+    uint32_t pass = 0;
+    do {
+        uint32_t blockCount = divideRoundingUp(count, REDUCE_BLOCK_SIZE);
+        VulkanBuffer* destination = blockCount > 1 ? &primitives->reducePartials[pass % 2] : output;
+
+        PrimitivePushConstants pushConstants = {count, 0, 0, 0};
+        VkDescriptorSet descriptorSet = allocatePrimitiveSet(context, primitives, source, destination, nullptr, nullptr, nullptr);
+        recordPrimitiveDispatch(commandBuffer, primitives, PRIMITIVE_REDUCE, descriptorSet, pushConstants, blockCount);
+
+        source = destination;
+        count = blockCount;
+        ++pass;
+    } while (count > 1);
+
+    submitPrimitiveCommands(context, primitives, commandBuffer);
+}
+
+void prefixSum(VulkanContext* context, VulkanPrimitives* primitives, VulkanBuffer* input, VulkanBuffer* output, uint32_t count, bool inclusive) {
+    std::lock_guard<std::mutex> lock(primitives->mutex);
+    checkPrimitiveCount(primitives, count);
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands(context);
+    recordScan(context, primitives, commandBuffer, input, output, count, inclusive, 0);
+    submitPrimitiveCommands(context, primitives, commandBuffer);
+}
+
+void computeHistogram(VulkanContext* context, VulkanPrimitives* primitives, VulkanBuffer* input, VulkanBuffer* histogram, uint32_t count, uint32_t binCount, uint32_t shift) {
+    std::lock_guard<std::mutex> lock(primitives->mutex);
+    checkPrimitiveCount(primitives, count);
+    if (binCount == 0 || binCount > PRIMITIVE_MAX_HISTOGRAM_BINS) {
+        throw std::runtime_error("histogram bin count must be between 1 and 1024");
+    }
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands(context);
+
+    vkCmdFillBuffer(commandBuffer, histogram->buffer, 0, binCount * sizeof(uint32_t), 0);
+    recordPrimitiveBarrier(commandBuffer, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+    PrimitivePushConstants pushConstants = {count, shift, 0, binCount};
+    VkDescriptorSet descriptorSet = allocatePrimitiveSet(context, primitives, input, histogram, nullptr, nullptr, nullptr);
+    recordPrimitiveDispatch(commandBuffer, primitives, PRIMITIVE_HISTOGRAM, descriptorSet, pushConstants, divideRoundingUp(count, HISTOGRAM_BLOCK_SIZE));
+
+    submitPrimitiveCommands(context, primitives, commandBuffer);
+}
+
+void compactBuffer(VulkanContext* context, VulkanPrimitives* primitives, VulkanBuffer* input, VulkanBuffer* flags, VulkanBuffer* output, VulkanBuffer* outputCount, uint32_t count, uint32_t dispatchGroupSize) {
+    std::lock_guard<std::mutex> lock(primitives->mutex);
+    checkPrimitiveCount(primitives, count);
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands(context);
+
+    if (count == 0) {
+        // No invocation would write the count, so clear it and the dispatch arguments here
+        vkCmdFillBuffer(commandBuffer, outputCount->buffer, 0, dispatchGroupSize > 0 ? 4 * sizeof(uint32_t) : sizeof(uint32_t), 0);
+        submitPrimitiveCommands(context, primitives, commandBuffer);
+        return;
+    }
+
+    recordScan(context, primitives, commandBuffer, flags, &primitives->scanOffsets, count, false, 0);
+
+    PrimitivePushConstants pushConstants = {count, 0, 0, dispatchGroupSize};
+    VkDescriptorSet descriptorSet = allocatePrimitiveSet(context, primitives, input, flags, &primitives->scanOffsets, output, outputCount);
+    recordPrimitiveDispatch(commandBuffer, primitives, PRIMITIVE_COMPACT_SCATTER, descriptorSet, pushConstants, divideRoundingUp(count, SCAN_BLOCK_SIZE));
+
+    submitPrimitiveCommands(context, primitives, commandBuffer);
+}
+
+void radixSortPairs(VulkanContext* context, VulkanPrimitives* primitives, VulkanBuffer* keys, VulkanBuffer* values, uint32_t count) {
+    std::lock_guard<std::mutex> lock(primitives->mutex);
+    checkPrimitiveCount(primitives, count);
+    if (count == 0) {
+        return;
+    }
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands(context);
+
+    uint32_t blockCount = divideRoundingUp(count, RADIX_BLOCK_SIZE);
+    uint32_t flags = values ? 1u : 0u;
+    VulkanBuffer* keyBuffers[2] = {keys, &primitives->sortKeys};
+    VulkanBuffer* valueBuffers[2] = {values, values ? &primitives->sortValues : nullptr};
+
+    // The sets only depend on the ping-pong direction, so they are shared by all passes
+    VkDescriptorSet countSets[2];
+    VkDescriptorSet scatterSets[2];
+    for (uint32_t i = 0; i < 2; ++i) {
+        countSets[i] = allocatePrimitiveSet(context, primitives, keyBuffers[i], nullptr, &primitives->scanOffsets, nullptr, nullptr);
+        scatterSets[i] = allocatePrimitiveSet(context, primitives, keyBuffers[i], valueBuffers[i], &primitives->scanOffsets, keyBuffers[1 - i], valueBuffers[1 - i]);
+    }
+
+    // 8 passes of 4 bits leave the sorted result back in the caller's buffers
+    for (uint32_t pass = 0; pass < 8; ++pass) {
+        uint32_t source = pass % 2;
+        PrimitivePushConstants pushConstants = {count, pass * 4, flags, 0};
+
+        recordPrimitiveDispatch(commandBuffer, primitives, PRIMITIVE_RADIX_COUNT, countSets[source], pushConstants, blockCount);
+        recordScan(context, primitives, commandBuffer, &primitives->scanOffsets, &primitives->scanOffsets, RADIX_DIGITS * blockCount, false, 0);
+        recordPrimitiveDispatch(commandBuffer, primitives, PRIMITIVE_RADIX_SCATTER, scatterSets[source], pushConstants, blockCount);
+    }
+
+    submitPrimitiveCommands(context, primitives, commandBuffer);
+}
@@ -0,0 +1,380 @@
+#include "vulkan/vulkan_core.h"
+#include "vulkan_base.h"
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+static bool hasQueuedJobs(VulkanScheduler* scheduler) {
+    for (auto& queue : scheduler->queues) {
+        if (!queue.empty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Highest priority first and in submission order within a priority, the caller holds the scheduler lock.
+// A batch ends early when its staging buffer would no longer fit the 32-bit size of createBuffer()
+static std::vector<VulkanScheduledJob*> takeBatch(VulkanScheduler* scheduler) {
+    uint32_t room = scheduler->maxJobsInFlight - scheduler->jobsInFlight;
+    uint32_t batchSize = room < scheduler->maxBatchSize ? room : scheduler->maxBatchSize;
+
+    std::vector<VulkanScheduledJob*> jobs;
+    VkDeviceSize stagingSize = 0;
+    for (int priority = (int)JobPriority::HIGH; priority >= (int)JobPriority::LOW && jobs.size() < batchSize; --priority) {
+        std::deque<VulkanScheduledJob*>& queue = scheduler->queues[priority];
+        while (!queue.empty() && jobs.size() < batchSize) {
+            if (!jobs.empty() && stagingSize + queue.front()->stagingSize > UINT32_MAX) {
+                return jobs;
+            }
+            stagingSize += queue.front()->stagingSize;
+            jobs.push_back(queue.front());
+            queue.pop_front();
+        }
+    }
+    return jobs;
+}
+
+static void recordBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStage, VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) {
+    VkMemoryBarrier barrier = {VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+    barrier.srcAccessMask = srcAccess;
+    barrier.dstAccessMask = dstAccess;
+    vkCmdPipelineBarrier(
+        commandBuffer,
+        srcStage,
+        dstStage,
+        0,
+        1, &barrier,
+        0, nullptr,
+        0, nullptr
+    );
+}
+
+static void releaseBatchResources(VulkanContext* context, VulkanJobBatch* batch) {
+    for (size_t i = 0; i < batch->descriptorSets.size(); ++i) {
+        releaseJobDescriptorSet(batch->jobs[i]->job.descriptorAllocator, batch->descriptorSets[i]);
+    }
+    batch->descriptorSets.clear();
+    if (batch->stagingBuffer.buffer != VK_NULL_HANDLE) {
+        if (batch->stagingData != nullptr) {
+            vkUnmapMemory(context->device, batch->stagingBuffer.memory);
+        }
+        destroyBuffer(context, &batch->stagingBuffer);
+        batch->stagingBuffer = {};
+    }
+}
+
+// Records uploads, the dispatches of every pipeline and the downloads of all jobs into one command buffer and submits it
+static void submitBatch(VulkanScheduler* scheduler, VulkanJobBatch* batch) {
+    VulkanContext* context = scheduler->context;
+    for (VulkanScheduledJob* scheduled : batch->jobs) {
+        VulkanComputeJob& job = scheduled->job;
+        if (job.resources.size() != job.descriptorAllocator->bindingCount) {
+            throw std::runtime_error("job resources do not match the bindings of its descriptor allocator");
+        }
+        if (job.pushConstants.size() != job.pipeline->pushConstantSize) {
+            throw std::runtime_error("job push constants do not match the size of its pipeline");
+        }
+    }
+
+    // Staging memory holds every upload followed by every download
+    VkDeviceSize stagingSize = 0;
+    for (VulkanScheduledJob* scheduled : batch->jobs) {
+        for (const VulkanJobUpload& upload : scheduled->job.uploads) {
+            stagingSize += upload.size;
+        }
+    }
+    VkDeviceSize uploadSize = stagingSize;
+    for (VulkanScheduledJob* scheduled : batch->jobs) {
+        for (const VulkanJobDownload& download : scheduled->job.downloads) {
+            batch->downloadOffsets.push_back(stagingSize);
+            stagingSize += download.size;
+        }
+    }
+    if (stagingSize > UINT32_MAX) {
+        throw std::runtime_error("staging memory of a job batch exceeds 4 GiB");
+    }
+    if (stagingSize > 0) {
+        createBuffer(
+            context,
+            &batch->stagingBuffer, static_cast<uint32_t>(stagingSize),
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+        );
+        batch->stagingSize = stagingSize;
+        vkMapMemory(context->device, batch->stagingBuffer.memory, 0, stagingSize, 0, &batch->stagingData);
+    }
+
+    for (VulkanScheduledJob* scheduled : batch->jobs) {
+        VulkanComputeJob& job = scheduled->job;
+        VkDescriptorSet descriptorSet = allocateJobDescriptorSet(context, job.descriptorAllocator);
+        batch->descriptorSets.push_back(descriptorSet);
+        updateJobDescriptorSet(context, job.descriptorAllocator, descriptorSet, job.resources.data());
+    }
+
+    if (batch->commandBuffer == VK_NULL_HANDLE) {
+        VkCommandBufferAllocateInfo allocInfo = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandPool = getThreadCommandPool(context);
+        allocInfo.commandBufferCount = 1;
+        if (vkAllocateCommandBuffers(context->device, &allocInfo, &batch->commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate scheduler command buffer");
+        }
+    }
+    VkCommandBuffer commandBuffer = batch->commandBuffer;
+
+    VkCommandBufferBeginInfo beginInfo = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+    // Jobs of earlier batches may still write buffers that jobs of this one use
+    recordBarrier(
+        commandBuffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT
+    );
+
+    if (uploadSize > 0) {
+        VkDeviceSize stagingOffset = 0;
+        for (VulkanScheduledJob* scheduled : batch->jobs) {
+            if (!scheduled->uploadData.empty()) {
+                memcpy(static_cast<char*>(batch->stagingData) + stagingOffset, scheduled->uploadData.data(), scheduled->uploadData.size());
+            }
+            for (const VulkanJobUpload& upload : scheduled->job.uploads) {
+                VkBufferCopy region = {stagingOffset, upload.offset, upload.size};
+                vkCmdCopyBuffer(commandBuffer, batch->stagingBuffer.buffer, upload.buffer->buffer, 1, &region);
+                stagingOffset += upload.size;
+            }
+        }
+        recordBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+    }
+
+    // Compatible jobs, those of the same pipeline, run every stage back to back with one barrier per stage
+    std::vector<bool> recorded(batch->jobs.size(), false);
+    for (size_t first = 0; first < batch->jobs.size(); ++first) {
+        if (recorded[first]) {
+            continue;
+        }
+        VulkanPipeline* pipeline = batch->jobs[first]->job.pipeline;
+        std::vector<VkDescriptorSet> descriptorSets;
+        std::vector<const void*> pushConstants;
+        for (size_t i = first; i < batch->jobs.size(); ++i) {
+            if (!recorded[i] && batch->jobs[i]->job.pipeline == pipeline) {
+                descriptorSets.push_back(batch->descriptorSets[i]);
+                pushConstants.push_back(batch->jobs[i]->job.pushConstants.data());
+                recorded[i] = true;
+            }
+        }
+        recordPipelineBatch(commandBuffer, pipeline, static_cast<uint32_t>(descriptorSets.size()), descriptorSets.data(), pushConstants.data());
+    }
+
+    if (!batch->downloadOffsets.empty()) {
+        recordBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+        size_t download = 0;
+        for (VulkanScheduledJob* scheduled : batch->jobs) {
+            for (const VulkanJobDownload& jobDownload : scheduled->job.downloads) {
+                VkBufferCopy region = {jobDownload.offset, batch->downloadOffsets[download++], jobDownload.size};
+                vkCmdCopyBuffer(commandBuffer, jobDownload.buffer->buffer, batch->stagingBuffer.buffer, 1, &region);
+            }
+        }
+        recordBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+    }
+
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to record scheduler command buffer!");
+    }
+    batch->submission = submitCommandBuffers(context, 1, &commandBuffer, VK_NULL_HANDLE);
+}
+
+static void failJobs(const std::vector<VulkanScheduledJob*>& jobs, std::exception_ptr error) {
+    for (VulkanScheduledJob* scheduled : jobs) {
+        scheduled->promise.set_exception(error);
+        delete scheduled;
+    }
+}
+
+static void runSubmitThread(VulkanScheduler* scheduler) {
+    VulkanContext* context = scheduler->context;
+    while (true) {
+        VulkanJobBatch* batch = new VulkanJobBatch;
+        batch->commandBuffer = VK_NULL_HANDLE;
+        batch->stagingBuffer = {};
+        batch->stagingSize = 0;
+        batch->stagingData = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(scheduler->mutex);
+            scheduler->wakeUp.wait(lock, [scheduler]() {
+                bool queued = hasQueuedJobs(scheduler);
+                return (queued && scheduler->jobsInFlight < scheduler->maxJobsInFlight) || (scheduler->stopping && !queued);
+            });
+            if (!hasQueuedJobs(scheduler)) {
+                delete batch;
+                break;
+            }
+            batch->jobs = takeBatch(scheduler);
+            scheduler->jobsInFlight += static_cast<uint32_t>(batch->jobs.size());
+            if (!scheduler->freeCommandBuffers.empty()) {
+                batch->commandBuffer = scheduler->freeCommandBuffers.back();
+                scheduler->freeCommandBuffers.pop_back();
+            }
+        }
+
+        try {
+            submitBatch(scheduler, batch);
+        } catch (...) {
+            releaseBatchResources(context, batch);
+            failJobs(batch->jobs, std::current_exception());
+            {
+                std::lock_guard<std::mutex> lock(scheduler->mutex);
+                scheduler->jobsInFlight -= static_cast<uint32_t>(batch->jobs.size());
+                if (batch->commandBuffer != VK_NULL_HANDLE) {
+                    scheduler->freeCommandBuffers.push_back(batch->commandBuffer);
+                }
+            }
+            delete batch;
+            continue;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(scheduler->mutex);
+            scheduler->batchesInFlight.push_back(batch);
+            scheduler->submittedBatches++;
+            scheduler->submittedJobs += batch->jobs.size();
+        }
+        scheduler->wakeUp.notify_all();
+    }
+
+    // Command buffers have to be freed by this thread, once the retire thread has handed all of them back
+    {
+        std::unique_lock<std::mutex> lock(scheduler->mutex);
+        scheduler->wakeUp.wait(lock, [scheduler]() {
+            return scheduler->jobsInFlight == 0;
+        });
+        if (!scheduler->freeCommandBuffers.empty()) {
+            freeThreadCommandBuffers(context, scheduler->freeCommandBuffers);
+            scheduler->freeCommandBuffers.clear();
+        }
+        scheduler->submitThreadDone = true;
+    }
+    scheduler->wakeUp.notify_all();
+    releaseThreadCommandPool(context);
+}
+
+static void runRetireThread(VulkanScheduler* scheduler) {
+    VulkanContext* context = scheduler->context;
+    while (true) {
+        VulkanJobBatch* batch;
+        {
+            std::unique_lock<std::mutex> lock(scheduler->mutex);
+            scheduler->wakeUp.wait(lock, [scheduler]() {
+                return !scheduler->batchesInFlight.empty() || scheduler->submitThreadDone;
+            });
+            if (scheduler->batchesInFlight.empty()) {
+                break;
+            }
+            batch = scheduler->batchesInFlight.front();
+            scheduler->batchesInFlight.pop_front();
+        }
+
+        std::exception_ptr error;
+        try {
+            // Batches finish in submission order, so waiting for the oldest one never blocks a finished one
+            waitForSubmission(context, batch->submission);
+        } catch (...) {
+            error = std::current_exception();
+        }
+
+        if (!error) {
+            size_t download = 0;
+            for (VulkanScheduledJob* scheduled : batch->jobs) {
+                for (const VulkanJobDownload& jobDownload : scheduled->job.downloads) {
+                    memcpy(jobDownload.data, static_cast<char*>(batch->stagingData) + batch->downloadOffsets[download++], jobDownload.size);
+                }
+            }
+        }
+        releaseBatchResources(context, batch);
+        if (error) {
+            failJobs(batch->jobs, error);
+        } else {
+            for (VulkanScheduledJob* scheduled : batch->jobs) {
+                scheduled->promise.set_value();
+                delete scheduled;
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(scheduler->mutex);
+            scheduler->jobsInFlight -= static_cast<uint32_t>(batch->jobs.size());
+            scheduler->freeCommandBuffers.push_back(batch->commandBuffer);
+        }
+        scheduler->wakeUp.notify_all();
+        delete batch;
+    }
+}
+
+VulkanScheduler* createScheduler(VulkanContext* context, uint32_t maxJobsInFlight, uint32_t maxBatchSize) {
+    if (maxJobsInFlight == 0 || maxBatchSize == 0) {
+        throw std::runtime_error("scheduler needs room for at least one job in flight and per batch");
+    }
+    VulkanScheduler* scheduler = new VulkanScheduler;
+    scheduler->context = context;
+    scheduler->maxJobsInFlight = maxJobsInFlight;
+    scheduler->maxBatchSize = maxBatchSize;
+    scheduler->jobsInFlight = 0;
+    scheduler->submittedBatches = 0;
+    scheduler->submittedJobs = 0;
+    scheduler->stopping = false;
+    scheduler->submitThreadDone = false;
+    scheduler->submitThread = std::thread(runSubmitThread, scheduler);
+    scheduler->retireThread = std::thread(runRetireThread, scheduler);
+    return scheduler;
+}
+
+std::future<void> submitJob(VulkanScheduler* scheduler, VulkanComputeJob job) {
+    VulkanScheduledJob* scheduled = new VulkanScheduledJob;
+    scheduled->job = std::move(job);
+    // The caller may reuse the upload data as soon as this returns, long before the submit thread records the job
+    size_t uploadSize = 0;
+    for (const VulkanJobUpload& upload : scheduled->job.uploads) {
+        uploadSize += upload.size;
+    }
+    scheduled->stagingSize = uploadSize;
+    for (const VulkanJobDownload& download : scheduled->job.downloads) {
+        scheduled->stagingSize += download.size;
+    }
+    if (scheduled->stagingSize > UINT32_MAX) {
+        delete scheduled;
+        throw std::runtime_error("uploads and downloads of a job exceed 4 GiB of staging memory");
+    }
+    scheduled->uploadData.resize(uploadSize);
+    size_t uploadOffset = 0;
+    for (VulkanJobUpload& upload : scheduled->job.uploads) {
+        memcpy(scheduled->uploadData.data() + uploadOffset, upload.data, upload.size);
+        upload.data = nullptr;
+        uploadOffset += upload.size;
+    }
+    std::future<void> future = scheduled->promise.get_future();
+    {
+        std::lock_guard<std::mutex> lock(scheduler->mutex);
+        if (scheduler->stopping) {
+            delete scheduled;
+            throw std::runtime_error("job submitted to a scheduler that is being destroyed");
+        }
+        scheduler->queues[(int)scheduled->job.priority].push_back(scheduled);
+    }
+    scheduler->wakeUp.notify_all();
+    return future;
+}
+
+void destroyScheduler(VulkanScheduler* scheduler) {
+    {
+        std::lock_guard<std::mutex> lock(scheduler->mutex);
+        scheduler->stopping = true;
+    }
+    scheduler->wakeUp.notify_all();
+    scheduler->submitThread.join();
+    scheduler->retireThread.join();
+    LOG("Scheduler ran " << scheduler->submittedJobs << " jobs in " << scheduler->submittedBatches << " submissions");
+    delete scheduler;
+}